@@ -0,0 +1,97 @@
+/**
+ * @file CRC-Benchmark.ino
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Throughput of the table driven CRC-16/Modbus against the bit by bit calculation
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <Arduino.h>
+#include <RAK13015.h>
+
+/** Frame size used for the benchmark, a full Modbus RTU buffer */
+#define BENCH_FRAME MAX_BUFFER
+/** Number of frames per measurement */
+#define BENCH_LOOPS 10000
+
+/** Test frame */
+uint8_t frame[BENCH_FRAME];
+
+/**
+ * @brief Bit by bit CRC-16/Modbus, the calculation used before the lookup table
+ *
+ * @param data Data
+ * @param length Number of bytes
+ * @return uint16_t CRC, low byte is sent first
+ */
+uint16_t crc_bitwise(const uint8_t *data, uint16_t length)
+{
+	uint16_t crc = 0xFFFF;
+	for (uint16_t idx = 0; idx < length; idx++)
+	{
+		crc ^= data[idx];
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x0001) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+		}
+	}
+	return crc;
+}
+
+void setup(void)
+{
+	// Wait for Serial to be available
+	pinMode(LED_GREEN, OUTPUT);
+	pinMode(LED_BLUE, OUTPUT);
+	Serial.begin(115200);
+	time_t serial_timeout = millis();
+	// On nRF52840 the USB serial is not available immediately
+	while (!Serial)
+	{
+		if ((millis() - serial_timeout) < 5000)
+		{
+			delay(100);
+			digitalWrite(LED_GREEN, !digitalRead(LED_GREEN));
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	for (uint16_t idx = 0; idx < BENCH_FRAME; idx++)
+	{
+		frame[idx] = (uint8_t)(idx * 37 + 5);
+	}
+}
+
+void loop(void)
+{
+	volatile uint16_t result = 0;
+
+	uint32_t start = micros();
+	for (uint16_t loop = 0; loop < BENCH_LOOPS; loop++)
+	{
+		frame[0] = (uint8_t)loop;
+		result ^= crc_bitwise(frame, BENCH_FRAME);
+	}
+	uint32_t bitwise_us = micros() - start;
+
+	start = micros();
+	for (uint16_t loop = 0; loop < BENCH_LOOPS; loop++)
+	{
+		frame[0] = (uint8_t)loop;
+		result ^= Modbus::calcCRC(frame, BENCH_FRAME);
+	}
+	uint32_t table_us = micros() - start;
+
+	// Both must give the same CRC, the check value of "123456789" is 0x4B37
+	const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+	Serial.println("===============================================================");
+	Serial.printf("CRC check %04X %04X (expected 4B37)\r\n", crc_bitwise(check, 9), Modbus::calcCRC(check, 9));
+	Serial.printf("Bit by bit: %.2f bytes/us\r\n", (float)BENCH_FRAME * BENCH_LOOPS / bitwise_us);
+	Serial.printf("%s table: %.2f bytes/us\r\n", MODBUS_CRC_FULL_TABLE ? "512 byte" : "32 byte nibble", (float)BENCH_FRAME * BENCH_LOOPS / table_us);
+	delay(10000);
+}
@@ -0,0 +1,116 @@
+/**
+ * @file Modbus-Async.ino
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Read Modbus registers without blocking while the ADC channels are read
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include <RAK13015.h>
+
+// Setup RAk13015 for RAK19007 Base Board and Slot D
+RAK13015 rak_in(SLOT_D, RAK19007);
+
+/** Registers of Modbus slave device #1 and #2 */
+uint16_t regs_1[5];
+uint16_t regs_2[2];
+
+/** Transactions, both are sent one after the other */
+rak13015_modbus_t read_1 = {1, MB_FC_READ_REGISTERS, 0, 5, regs_1, 1000};
+rak13015_modbus_t read_2 = {2, MB_FC_READ_REGISTERS, 10, 2, regs_2, 1000};
+
+/** Time of the last Modbus request */
+time_t last_request = 0;
+
+bool has_rak13015 = false;
+
+/**
+ * @brief Called from serviceModbus() when a transaction is finished
+ *
+ * @param transaction The finished transaction
+ */
+void modbus_done(rak13015_modbus_t *transaction)
+{
+	switch (transaction->status)
+	{
+	case RAK13015_MB_DONE:
+		Serial.printf("Modbus device %d HEX 0: %04X 1: %04X\r\n", transaction->slave, transaction->regs[0], transaction->regs[1]);
+		break;
+	case RAK13015_MB_EXCEPTION:
+		Serial.printf("Modbus device %d exception %d\r\n", transaction->slave, transaction->result);
+		break;
+	case RAK13015_MB_TIMEOUT:
+		Serial.printf("Modbus device %d timeout\r\n", transaction->slave);
+		break;
+	default:
+		Serial.printf("Modbus device %d error %d\r\n", transaction->slave, transaction->result);
+		break;
+	}
+}
+
+void setup(void)
+{
+	// Wait for Serial to be available
+	pinMode(LED_GREEN, OUTPUT);
+	pinMode(LED_BLUE, OUTPUT);
+	Serial.begin(115200);
+	time_t serial_timeout = millis();
+	// On nRF52840 the USB serial is not available immediately
+	while (!Serial)
+	{
+		if ((millis() - serial_timeout) < 5000)
+		{
+			delay(100);
+			digitalWrite(LED_GREEN, !digitalRead(LED_GREEN));
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	// Power up the RAK13015
+	pinMode(WB_IO2, OUTPUT);
+	digitalWrite(WB_IO2, HIGH);
+	delay(500);
+
+	has_rak13015 = rak_in.initRAK13015(SGM58031_FS_4_096, 9600);
+
+	if (has_rak13015)
+	{
+		Serial.println("RAK13015 initialized");
+	}
+	else
+	{
+		Serial.println("No RAK13015 found");
+	}
+}
+
+void loop(void)
+{
+	if (!has_rak13015)
+	{
+		delay(10000);
+		return;
+	}
+
+	if ((millis() - last_request) > 10000)
+	{
+		last_request = millis();
+		// Both return immediately, the transactions are still running if the slaves did not answer yet
+		rak_in.submitModbus(&read_1, modbus_done);
+		rak_in.submitModbus(&read_2, modbus_done);
+
+		// The ADC channels are read while the Modbus slaves answer
+		Serial.println("===============================================================");
+		Serial.printf("4-20mA: %.2f %.2f %.2f mA Analog: %.2f %.2f V\r\n", rak_in.read4_20ma(I_4_20_CH_0), rak_in.read4_20ma(I_4_20_CH_1),
+					  rak_in.read4_20ma(I_4_20_CH_2), rak_in.readAnalog(ANA_CH_0), rak_in.readAnalog(ANA_CH_1));
+	}
+
+	// Receive the responses and send the next queued request
+	rak_in.serviceModbus();
+}
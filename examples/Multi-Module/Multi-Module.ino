@@ -0,0 +1,100 @@
+/**
+ * @file Multi-Module.ino
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Read two RAK13015 modules on one RAK19001 Base Board
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include <RAK13015.h>
+
+// Setup RAK13015 for RAK19001 Base Board Slot D and Slot E
+// The ADC addresses are fixed, each module needs its own I2C bus
+RAK13015 rak_in_d(SLOT_D, RAK19001, Wire);
+RAK13015 rak_in_e(SLOT_E, RAK19001, Wire1);
+
+/** Modules for the aggregate scan */
+RAK13015 *modules[2] = {&rak_in_d, &rak_in_e};
+/** Readings of each module */
+rak13015_snapshot_t snapshots[2];
+
+bool has_rak13015 = false;
+
+void setup(void)
+{
+	// Wait for Serial to be available
+	pinMode(LED_GREEN, OUTPUT);
+	pinMode(LED_BLUE, OUTPUT);
+	Serial.begin(115200);
+	time_t serial_timeout = millis();
+	// On nRF52840 the USB serial is not available immediately
+	while (!Serial)
+	{
+		if ((millis() - serial_timeout) < 5000)
+		{
+			delay(100);
+			digitalWrite(LED_GREEN, !digitalRead(LED_GREEN));
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	// Power up the RAK13015 modules
+	pinMode(WB_IO2, OUTPUT);
+	digitalWrite(WB_IO2, HIGH);
+	delay(500);
+
+	// Each module has its own ADCs and its own Modbus master on the UART of its slot
+	has_rak13015 = rak_in_d.initRAK13015(SGM58031_FS_4_096, 9600);
+	has_rak13015 &= rak_in_e.initRAK13015(SGM58031_FS_4_096, 9600);
+
+	if (has_rak13015)
+	{
+		Serial.println("RAK13015 modules initialized");
+	}
+	else
+	{
+		Serial.println("RAK13015 modules not found");
+	}
+}
+
+void loop(void)
+{
+	if (has_rak13015)
+	{
+		// Both modules are read in one interleaved pass
+		time_t start = millis();
+		uint8_t complete = RAK13015::readModules(modules, 2, snapshots);
+		Serial.println("===============================================================");
+		Serial.printf("%d modules read in %ld ms\r\n", complete, millis() - start);
+		for (uint8_t idx = 0; idx < 2; idx++)
+		{
+			Serial.printf("Slot %c 4-20mA: %.2f %.2f %.2f mA Analog: %.2f %.2f V\r\n", idx == 0 ? 'D' : 'E',
+						  snapshots[idx].values[RAK13015_CH_4_20_0], snapshots[idx].values[RAK13015_CH_4_20_1],
+						  snapshots[idx].values[RAK13015_CH_4_20_2], snapshots[idx].values[RAK13015_CH_ANA_0],
+						  snapshots[idx].values[RAK13015_CH_ANA_1]);
+		}
+
+		// Modbus slave device #1 on each RS485 bus
+		uint16_t coils_n_regs[8];
+		if (rak_in_d.requestModBus(1, 0, 5, coils_n_regs, 5000))
+		{
+			Serial.printf("Slot D Modbus device 1 HEX 0: %04X 1: %04X 2: %04X\r\n", coils_n_regs[0], coils_n_regs[1], coils_n_regs[2]);
+		}
+		if (rak_in_e.requestModBus(1, 0, 5, coils_n_regs, 5000))
+		{
+			Serial.printf("Slot E Modbus device 1 HEX 0: %04X 1: %04X 2: %04X\r\n", coils_n_regs[0], coils_n_regs[1], coils_n_regs[2]);
+		}
+	}
+	else
+	{
+		Serial.println("No RAK13015 available");
+	}
+	delay(30000);
+}
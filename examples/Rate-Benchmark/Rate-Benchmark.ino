@@ -0,0 +1,148 @@
+/**
+ * @file Rate-Benchmark.ino
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Throughput benchmark of the RAK13015 ADC for all sample rates and I2C clock speeds
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include <RAK13015.h>
+
+// Setup RAk13015 for RAK19007 Base Board and Slot D
+RAK13015 rak_in(SLOT_D, RAK19007);
+
+/** Channel used for the benchmark */
+#define BENCH_CHANNEL RAK13015_CH_4_20_0
+/** Port of the benchmark channel for read4_20ma() */
+#define BENCH_PORT I_4_20_CH_0
+/** Duration of each measurement in ms */
+#define BENCH_TIME 1000
+
+/** I2C clock speeds to test */
+const uint32_t i2c_clocks[] = {100000, 400000};
+
+/** Sample rates in ascending order */
+const uint8_t rates[SGM58031_SPS_NUM] = {SGM58031_SPS_6_25, SGM58031_SPS_7_5, SGM58031_SPS_12_5, SGM58031_SPS_15,
+										 SGM58031_SPS_25, SGM58031_SPS_30, SGM58031_SPS_50, SGM58031_SPS_60,
+										 SGM58031_SPS_100, SGM58031_SPS_120, SGM58031_SPS_200, SGM58031_SPS_240,
+										 SGM58031_SPS_400, SGM58031_SPS_480, SGM58031_SPS_800, SGM58031_SPS_960};
+
+/** Buffer for the acquisition samples */
+rak13015_sample_t samples[32];
+
+bool has_rak13015 = false;
+
+/**
+ * @brief Measure single-shot reads per second
+ *
+ * @return float achieved reads per second
+ */
+float bench_single_shot(void)
+{
+	uint32_t count = 0;
+	time_t start = millis();
+	while ((millis() - start) < BENCH_TIME)
+	{
+		if (rak_in.read4_20ma(BENCH_PORT) != -50.0)
+		{
+			count++;
+		}
+	}
+	return count * 1000.0 / (millis() - start);
+}
+
+/**
+ * @brief Measure samples per second of the interrupt driven acquisition
+ *
+ * @param lost Receives the number of lost samples
+ * @return float achieved samples per second, 0 if the slot has no ALERT pin
+ */
+float bench_acquisition(uint16_t &lost)
+{
+	uint32_t count = 0;
+	lost = 0;
+	if (!rak_in.startAcquisition(BENCH_CHANNEL, rak_in.getDataRate(BENCH_CHANNEL)))
+	{
+		return 0;
+	}
+	time_t start = millis();
+	while ((millis() - start) < BENCH_TIME)
+	{
+		rak_in.serviceAcquisition();
+		count += rak_in.readAcquisition(samples, 32);
+	}
+	rak_in.stopAcquisition();
+	lost = rak_in.getAcquisitionLost();
+	return count * 1000.0 / (millis() - start);
+}
+
+void setup(void)
+{
+	// Wait for Serial to be available
+	pinMode(LED_GREEN, OUTPUT);
+	pinMode(LED_BLUE, OUTPUT);
+	Serial.begin(115200);
+	time_t serial_timeout = millis();
+	// On nRF52840 the USB serial is not available immediately
+	while (!Serial)
+	{
+		if ((millis() - serial_timeout) < 5000)
+		{
+			delay(100);
+			digitalWrite(LED_GREEN, !digitalRead(LED_GREEN));
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	// Power up the RAK13015
+	pinMode(WB_IO2, OUTPUT);
+	digitalWrite(WB_IO2, HIGH);
+	delay(500);
+
+	// Only the analog and 4-20mA interfaces are used
+	has_rak13015 = rak_in.initAnalog_4_20(SGM58031_FS_4_096);
+
+	if (has_rak13015)
+	{
+		Serial.println("RAK13015 initialized");
+	}
+	else
+	{
+		Serial.println("No RAK13015 found");
+	}
+}
+
+void loop(void)
+{
+	if (has_rak13015)
+	{
+		for (uint8_t clk = 0; clk < sizeof(i2c_clocks) / sizeof(i2c_clocks[0]); clk++)
+		{
+			Wire.setClock(i2c_clocks[clk]);
+			Serial.println("===============================================================");
+			Serial.printf("I2C clock %ld Hz\r\n", i2c_clocks[clk]);
+			Serial.println("   Rate | Single-shot | Acquisition | Lost");
+			for (uint8_t idx = 0; idx < SGM58031_SPS_NUM; idx++)
+			{
+				uint16_t lost;
+				rak_in.setSampleRate(BENCH_CHANNEL, rates[idx]);
+				float single_shot = bench_single_shot();
+				float acquisition = bench_acquisition(lost);
+				Serial.printf("%7.2f | %11.2f | %11.2f | %4d\r\n", RAK_ADC_SGM58031::getSampleRate(rates[idx]), single_shot, acquisition, lost);
+			}
+		}
+		Wire.setClock(100000);
+	}
+	else
+	{
+		Serial.println("No RAK13015 available");
+	}
+	delay(60000);
+}
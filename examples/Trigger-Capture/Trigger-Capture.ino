@@ -0,0 +1,104 @@
+/**
+ * @file Trigger-Capture.ino
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Capture the samples around a rising edge of a 4-20mA signal
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include <RAK13015.h>
+#include <RAK13015_Trigger.h>
+
+// Setup RAk13015 for RAK19007 Base Board and Slot D
+RAK13015 rak_in(SLOT_D, RAK19007);
+
+/** Samples before the trigger */
+#define PRE_SAMPLES 64
+/** Samples from the trigger on */
+#define POST_SAMPLES 192
+
+/** Trigger engine for 4-20mA channel 0 */
+RAK13015_Trigger<PRE_SAMPLES + POST_SAMPLES> trigger;
+
+/** Buffer for the acquisition samples */
+rak13015_sample_t samples[32];
+/** Captured window */
+rak13015_sample_t window[PRE_SAMPLES + POST_SAMPLES];
+
+bool has_rak13015 = false;
+
+void setup(void)
+{
+	// Wait for Serial to be available
+	pinMode(LED_GREEN, OUTPUT);
+	pinMode(LED_BLUE, OUTPUT);
+	Serial.begin(115200);
+	time_t serial_timeout = millis();
+	// On nRF52840 the USB serial is not available immediately
+	while (!Serial)
+	{
+		if ((millis() - serial_timeout) < 5000)
+		{
+			delay(100);
+			digitalWrite(LED_GREEN, !digitalRead(LED_GREEN));
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	// Power up the RAK13015
+	pinMode(WB_IO2, OUTPUT);
+	digitalWrite(WB_IO2, HIGH);
+	delay(500);
+
+	// Only the analog and 4-20mA interfaces are used
+	has_rak13015 = rak_in.initAnalog_4_20(SGM58031_FS_4_096);
+
+	if (has_rak13015)
+	{
+		Serial.println("RAK13015 initialized");
+		// Capture when the current rises above 12 mA
+		trigger.setup(RAK13015_CH_4_20_0, RAK13015_TRIGGER_RISING, rak_in.toRaw(RAK13015_CH_4_20_0, 12.0), PRE_SAMPLES, POST_SAMPLES);
+		trigger.arm();
+		if (!rak_in.startAcquisition(RAK13015_CH_4_20_0, SGM58031_DR_400))
+		{
+			Serial.println("Acquisition not possible on this slot");
+			has_rak13015 = false;
+		}
+	}
+	else
+	{
+		Serial.println("No RAK13015 found");
+	}
+}
+
+void loop(void)
+{
+	if (!has_rak13015)
+	{
+		delay(10000);
+		return;
+	}
+	rak_in.serviceAcquisition();
+	uint16_t count = rak_in.readAcquisition(samples, 32);
+	for (uint16_t idx = 0; idx < count; idx++)
+	{
+		if (trigger.update(samples[idx]))
+		{
+			uint16_t size = trigger.read(window, PRE_SAMPLES + POST_SAMPLES);
+			Serial.println("===============================================================");
+			Serial.printf("Trigger at %ld us, %d samples\r\n", trigger.triggerTime(), size);
+			for (uint16_t pos = 0; pos < size; pos++)
+			{
+				Serial.printf("%ld %ld\r\n", (int32_t)(window[pos].timestamp - trigger.triggerTime()), rak_in.toMicro(RAK13015_CH_4_20_0, window[pos].raw));
+			}
+			trigger.arm();
+		}
+	}
+}
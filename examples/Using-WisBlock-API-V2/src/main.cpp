@@ -144,12 +144,16 @@ void app_event_handler(void)
 
 		if (has_rak13015)
 		{
-			payload.addAnalogInput(LPP_CHANNEL_4_20_CH0, rak_in.read4_20ma(I_4_20_CH_0));
-			payload.addAnalogInput(LPP_CHANNEL_4_20_CH1, rak_in.read4_20ma(I_4_20_CH_1));
-			payload.addAnalogInput(LPP_CHANNEL_4_20_CH2, rak_in.read4_20ma(I_4_20_CH_2));
+			// Read all 4-20mA and analog inputs in one pass
+			rak13015_snapshot_t snapshot;
+			rak_in.readAll(snapshot);
 
-			payload.addAnalogInput(LPP_CHANNEL_V_CH0, rak_in.readAnalog(ANA_CH_0));
-			payload.addAnalogInput(LPP_CHANNEL_V_CH1, rak_in.readAnalog(ANA_CH_1));
+			payload.addAnalogInput(LPP_CHANNEL_4_20_CH0, snapshot.values[RAK13015_CH_4_20_0]);
+			payload.addAnalogInput(LPP_CHANNEL_4_20_CH1, snapshot.values[RAK13015_CH_4_20_1]);
+			payload.addAnalogInput(LPP_CHANNEL_4_20_CH2, snapshot.values[RAK13015_CH_4_20_2]);
+
+			payload.addAnalogInput(LPP_CHANNEL_V_CH0, snapshot.values[RAK13015_CH_ANA_0]);
+			payload.addAnalogInput(LPP_CHANNEL_V_CH1, snapshot.values[RAK13015_CH_ANA_1]);
 
 			rak_in.requestModBus(1, 0, 5, coils_n_regs, 5000);
 			MYLOG("MODR", "0: %04X 1: %04X 2: %04X 3: %04X 4: %04X", coils_n_regs[0], coils_n_regs[1], coils_n_regs[2], coils_n_regs[3], coils_n_regs[4]);
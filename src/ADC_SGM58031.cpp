@@ -64,7 +64,13 @@ uint8_t RAK_ADC_SGM58031::writeByteRegister(uint8_t reg, uint8_t data)
   _wire->beginTransmission(i2cAddress);
   _wire->write(reg);
   _wire->write(data);
-  return _wire->endTransmission();
+  uint8_t result = _wire->endTransmission();
+  _pointer = (result == 0) ? reg : SGM58031_POINTER_UNKNOWN;
+  if (reg < SGM58031_SHADOW_SIZE)
+  {
+    _shadowValid &= ~(1 << reg);
+  }
+  return result;
 }
 
 /**
@@ -79,7 +85,62 @@ uint8_t RAK_ADC_SGM58031::writeWordRegister(uint8_t reg, uint16_t data)
   _wire->write(reg);
   _wire->write((uint8_t)(data >> 8));
   _wire->write((uint8_t)(data & 0xFF));
-  return _wire->endTransmission();
+  uint8_t result = _wire->endTransmission();
+  _pointer = (result == 0) ? reg : SGM58031_POINTER_UNKNOWN;
+  if (reg < SGM58031_SHADOW_SIZE)
+  {
+    if (result == 0)
+    {
+      // The OS bit is an action, not a state
+      _shadow[reg] = (reg == SGM58031_CONFIG_REGISTER) ? (data & ~SGM58031_CONFIG_OS) : data;
+      _shadowValid |= 1 << reg;
+    }
+    else
+    {
+      _shadowValid &= ~(1 << reg);
+    }
+  }
+  return result;
+}
+
+/**
+   @brief Writes 16-bits to the specified destination register if the value differs from the shadow copy
+   @param reg   Register address
+   @param data  Send data
+   @return Returns 0 on success or if the write was not required, and others on failure
+ **/
+uint8_t RAK_ADC_SGM58031::writeShadowedRegister(uint8_t reg, uint16_t data)
+{
+  if ((_shadowValid & (1 << reg)) && (_shadow[reg] == data))
+  {
+    return 0;
+  }
+  return writeWordRegister(reg, data);
+}
+
+/**
+   @brief Forget the shadow copies of the registers and the register pointer
+          Required after the ADC was powered down, the registers are back to their reset values
+ **/
+void RAK_ADC_SGM58031::resetShadow()
+{
+  _shadowValid = 0;
+  _pointer = SGM58031_POINTER_UNKNOWN;
+}
+
+/**
+   @brief Set the register pointer for a read, skipped if it already points to the register
+   @param reg   Register address
+ **/
+void RAK_ADC_SGM58031::setPointer(uint8_t reg)
+{
+  if (_pointer == reg)
+  {
+    return;
+  }
+  _wire->beginTransmission(i2cAddress);
+  _wire->write(reg);
+  _pointer = (_wire->endTransmission() == 0) ? reg : SGM58031_POINTER_UNKNOWN;
 }
 
 /**
@@ -90,10 +151,11 @@ uint8_t RAK_ADC_SGM58031::writeWordRegister(uint8_t reg, uint16_t data)
 uint8_t RAK_ADC_SGM58031::readByteRegister(uint8_t reg)
 {
   uint8_t regValue = 0;
-  _wire->beginTransmission(i2cAddress);
-  _wire->write(reg);
-  _wire->endTransmission();
-  _wire->requestFrom(i2cAddress, 1);
+  setPointer(reg);
+  if (_wire->requestFrom(i2cAddress, 1) == 0)
+  {
+    _pointer = SGM58031_POINTER_UNKNOWN;
+  }
   if (_wire->available())
   {
     regValue = _wire->read();
@@ -109,10 +171,12 @@ uint8_t RAK_ADC_SGM58031::readByteRegister(uint8_t reg)
 uint16_t RAK_ADC_SGM58031::readWordRegister(uint8_t reg)
 {
   uint8_t regValue[2] = {0};
-  _wire->beginTransmission(i2cAddress);
-  _wire->write(reg);
-  _wire->endTransmission();
-  _wire->requestFrom(i2cAddress, 2);
+  // Repeated reads of the same register, e.g. the conversion register in continuous mode, skip the pointer write
+  setPointer(reg);
+  if (_wire->requestFrom(i2cAddress, 2) == 0)
+  {
+    _pointer = SGM58031_POINTER_UNKNOWN;
+  }
   if (_wire->available())
   {
     for (uint8_t count = 0; count < 2; count++)
@@ -128,13 +192,66 @@ uint16_t RAK_ADC_SGM58031::readWordRegister(uint8_t reg)
    @return Voltage value after conversion
  **/
 float RAK_ADC_SGM58031::getVoltage()
+{
+  return rawToVoltage((int16_t)getAdcValue());
+}
+
+/**
+   @brief Convert a raw conversion result to voltage
+   @param raw  the conversion result, two's complement
+   @return Voltage value after conversion
+ **/
+float RAK_ADC_SGM58031::rawToVoltage(int16_t raw)
 {
   float voltage;
-  voltage = getAdcValue();
-  voltage = voltage * ReferenceVoltage / 32767.0; 
+  voltage = raw;
+  voltage = voltage * ReferenceVoltage / 32767.0;
   return voltage;
 }
 
+/**
+   @brief Get the PGA bits for a full scale range
+   @param full_scale  the full scale range SGM58031_FS_6_144 ... SGM58031_FS_0_256
+   @return the PGA bits of the smallest range that covers full_scale
+ **/
+uint16_t RAK_ADC_SGM58031::getPgaBits(float full_scale)
+{
+  uint16_t pga = SGM58031_PGA_0_256;
+  while ((pga > SGM58031_PGA_6_144) && (getFullScale(pga) < (full_scale - 0.001)))
+  {
+    pga -= SGM58031_PGA_STEP;
+  }
+  return pga;
+}
+
+/**
+   @brief Get the full scale range of the PGA bits of a config word
+   @param data  the config data
+   @return the full scale range in volt
+ **/
+float RAK_ADC_SGM58031::getFullScale(uint16_t data)
+{
+  static const float full_scale[8] = {SGM58031_FS_6_144, SGM58031_FS_4_096, SGM58031_FS_2_048, SGM58031_FS_1_024,
+                                      SGM58031_FS_0_512, SGM58031_FS_0_256, SGM58031_FS_0_256, SGM58031_FS_0_256};
+  return full_scale[(data & SGM58031_CONFIG_PGA) >> 9];
+}
+
+/**
+   @brief Convert a raw conversion result to microvolt without floating point
+          uV = (raw * mult + 2^31) >> 32 with mult = round(full_scale * 10^6 / 32767 * 2^32).
+          The result equals raw * full_scale / 32767 rounded half up (towards +infinity) for every raw value
+   @param raw  the conversion result, two's complement
+   @param data  the config data, only the PGA bits are used
+   @return voltage in uV
+ **/
+int32_t RAK_ADC_SGM58031::rawToMicrovolt(int16_t raw, uint16_t data)
+{
+  // uV per count * 2^32 for 6.144, 4.096, 2.048, 1.024, 0.512 and 0.256 V full scale
+  static const int64_t mult[8] = {805330944750LL, 536887296500LL, 268443648250LL, 134221824125LL,
+                                  67110912063LL, 33555456031LL, 33555456031LL, 33555456031LL};
+  return (int32_t)(((int64_t)raw * mult[(data & SGM58031_CONFIG_PGA) >> 9] + (1LL << 31)) >> 32);
+}
+
 /**
    @brief set the resolution voltage
    @param value  the resolution voltage value
@@ -159,7 +276,7 @@ float RAK_ADC_SGM58031::getVoltageResolution()
  **/
 void RAK_ADC_SGM58031::setAlertLowThreshold(uint16_t threshold)
 {
-  writeWordRegister(SGM58031_LOW_THRESH_REGISTER, threshold);
+  writeShadowedRegister(SGM58031_LOW_THRESH_REGISTER, threshold);
 }
 
 /**
@@ -177,7 +294,7 @@ uint16_t RAK_ADC_SGM58031::readAlertLowThreshold()
  **/
 void RAK_ADC_SGM58031::setAlertHighThreshold(uint16_t threshold)
 {
-  writeWordRegister(SGM58031_HIGH_THRESH_REGISTER, threshold);
+  writeShadowedRegister(SGM58031_HIGH_THRESH_REGISTER, threshold);
 }
 
 /**
@@ -193,11 +310,17 @@ uint16_t RAK_ADC_SGM58031::readAlertHighThreshold()
 /**
    @brief set the 16-bit register can be used to control the SGM58031 operating mode, input selection, data rate, PGA settings,
   and comparator modes
+          The write is skipped if nothing changes. In single-shot mode a set OS bit starts a conversion and is always written.
    @param data  the config data
  **/
 void RAK_ADC_SGM58031::setConfig(uint16_t data)
 {
-  writeWordRegister(SGM58031_CONFIG_REGISTER, data);
+  if ((data & SGM58031_CONFIG_MODE) && (data & SGM58031_CONFIG_OS))
+  {
+    writeWordRegister(SGM58031_CONFIG_REGISTER, data);
+    return;
+  }
+  writeShadowedRegister(SGM58031_CONFIG_REGISTER, data & ~SGM58031_CONFIG_OS);
 }
 
 /**
@@ -215,7 +338,7 @@ uint16_t RAK_ADC_SGM58031::getConfig()
  **/
 void RAK_ADC_SGM58031::setConfig1(uint16_t data)
 {
-  writeWordRegister(SGM58031_CONFIG1_REGISTER, data);
+  writeShadowedRegister(SGM58031_CONFIG1_REGISTER, data);
 }
 
 /**
@@ -227,6 +350,100 @@ uint16_t RAK_ADC_SGM58031::getConfig1()
   return readWordRegister(SGM58031_CONFIG1_REGISTER);
 }
 
+/**
+   @brief Select the data rate table with the Config1 DR_SEL bit
+          The table is used by all following conversions, in continuous mode restart the conversion after a change
+   @param alternate  true for 7.5 ... 960 SPS, false for 6.25 ... 800 SPS (reset value)
+ **/
+void RAK_ADC_SGM58031::setDataRateSelect(bool alternate)
+{
+  updateConfig1(SGM58031_CONFIG1_DR_SEL, alternate ? SGM58031_CONFIG1_DR_SEL : 0);
+}
+
+/**
+   @brief Get the data rate table selected with the Config1 DR_SEL bit
+   @return true for 7.5 ... 960 SPS, false for 6.25 ... 800 SPS
+ **/
+bool RAK_ADC_SGM58031::getDataRateSelect()
+{
+  return getConfig1Bit(SGM58031_CONFIG1_DR_SEL);
+}
+
+/**
+   @brief Use the external reference on AIN3 with the Config1 EXT_REF bit
+   @param enable  true for the external reference, false for the internal reference (reset value)
+ **/
+void RAK_ADC_SGM58031::setExternalReference(bool enable)
+{
+  updateConfig1(SGM58031_CONFIG1_EXT_REF, enable ? SGM58031_CONFIG1_EXT_REF : 0);
+}
+
+/**
+   @brief Get the reference selected with the Config1 EXT_REF bit
+   @return true for the external reference, false for the internal reference
+ **/
+bool RAK_ADC_SGM58031::getExternalReference()
+{
+  return getConfig1Bit(SGM58031_CONFIG1_EXT_REF);
+}
+
+/**
+   @brief Select a sample rate of the full range 6.25 ... 960 SPS
+          Sets the Config1 DR_SEL bit of the rate table, no I2C access if it is already set
+   @param rate  sample rate code SGM58031_SPS_6_25 ... SGM58031_SPS_960
+   @return the DR bits for the config word
+ **/
+uint16_t RAK_ADC_SGM58031::selectSampleRate(uint8_t rate)
+{
+  setDataRateSelect((rate & SGM58031_SPS_DR_SEL) != 0);
+  return (uint16_t)(rate & 0x07) << 5;
+}
+
+/**
+   @brief Samples per second of a sample rate code
+   @param rate  sample rate code SGM58031_SPS_6_25 ... SGM58031_SPS_960
+   @return samples per second, 0 for an invalid code
+ **/
+float RAK_ADC_SGM58031::getSampleRate(uint8_t rate)
+{
+  static const float sps[SGM58031_SPS_NUM] = {6.25, 12.5, 25, 50, 100, 200, 400, 800, 7.5, 15, 30, 60, 120, 240, 480, 960};
+  return rate < SGM58031_SPS_NUM ? sps[rate] : 0;
+}
+
+/**
+   @brief Change bits of the Config1 register, the other bits are kept
+          The register is read from the chip only if there is no valid shadow copy
+   @param mask  bits to change
+   @param value  new value of the bits
+ **/
+void RAK_ADC_SGM58031::updateConfig1(uint16_t mask, uint16_t value)
+{
+  uint16_t config1;
+  if (_shadowValid & (1 << SGM58031_CONFIG1_REGISTER))
+  {
+    config1 = _shadow[SGM58031_CONFIG1_REGISTER];
+  }
+  else
+  {
+    config1 = getConfig1();
+  }
+  setConfig1((config1 & ~mask) | (value & mask));
+}
+
+/**
+   @brief Get a bit of the Config1 register
+   @param mask  the bit
+   @return true if the bit is set
+ **/
+bool RAK_ADC_SGM58031::getConfig1Bit(uint16_t mask)
+{
+  if (_shadowValid & (1 << SGM58031_CONFIG1_REGISTER))
+  {
+    return (_shadow[SGM58031_CONFIG1_REGISTER] & mask) != 0;
+  }
+  return (getConfig1() & mask) != 0;
+}
+
 /**
    @brief Gets the chip ID
    @return the Chip Id
@@ -262,3 +479,264 @@ uint16_t RAK_ADC_SGM58031::getAdcValue()
 {
   return readWordRegister(SGM58031_CONVERSION_REGISTER);
 }
+
+
+/**
+   @brief Use the ALERT/RDY pin to detect the end of a conversion
+          Programs the threshold registers to switch ALERT/RDY into conversion ready mode.
+          The pin can be shared with other devices, the OS bit is still checked once the pin is asserted.
+   @param pin  the ALERT/RDY GPIO, -1 to poll the OS bit of the config register only
+ **/
+void RAK_ADC_SGM58031::setReadyPin(int pin)
+{
+  bool wasUsed = _readyPin >= 0;
+  _readyPin = pin;
+  if (_readyPin < 0)
+  {
+    if (wasUsed)
+    {
+      // Disable the comparator to release the ALERT/RDY line
+      setConfig((getConfig() & ~SGM58031_CONFIG_OS) | SGM58031_CONFIG_COMP_QUE);
+    }
+    return;
+  }
+  pinMode(_readyPin, INPUT_PULLUP);
+  setAlertHighThreshold(SGM58031_RDY_HIGH_THRESH);
+  setAlertLowThreshold(SGM58031_RDY_LOW_THRESH);
+}
+
+/**
+   @brief Start a single-shot conversion
+          If a ready pin is used, the comparator queue is enabled to assert ALERT/RDY at the end of the conversion
+   @param data  the config data, the OS bit is set automatically
+ **/
+void RAK_ADC_SGM58031::startConversion(uint16_t data)
+{
+  data |= SGM58031_CONFIG_OS;
+  if (_readyPin >= 0)
+  {
+    data &= ~SGM58031_CONFIG_COMP_QUE;
+  }
+  // Fastest possible end of the conversion, tolerance of the oscillator removed
+  _convMin = getSamplePeriod(data) * (100 - SGM58031_CONV_TOLERANCE) / 100;
+  _convTime = getConversionTime(data);
+  setConfig(data);
+  _convStart = micros();
+}
+
+/**
+   @brief Check if the last started conversion has finished
+          The I2C bus is not accessed before the conversion time of the data rate has passed.
+          With a ready pin the I2C bus is only accessed when the pin is asserted
+   @return true if no conversion is in progress
+ **/
+bool RAK_ADC_SGM58031::isConversionReady()
+{
+  // No I2C traffic before the conversion can possibly be done
+  if ((micros() - _convStart) < _convMin)
+  {
+    return false;
+  }
+  if ((_readyPin >= 0) && (digitalRead(_readyPin) != LOW))
+  {
+    return false;
+  }
+  return (getConfig() & SGM58031_CONFIG_OS) != 0;
+}
+
+/**
+   @brief Wait until the last started conversion has finished
+   @param timeout  maximum wait time in ms, 0 to wait for the worst-case conversion time of the last started conversion
+   @return true if the conversion finished, false on timeout
+ **/
+bool RAK_ADC_SGM58031::waitConversionReady(uint16_t timeout)
+{
+  uint32_t timeout_us = (timeout == 0) ? _convTime : (uint32_t)timeout * 1000;
+  while ((micros() - _convStart) < timeout_us)
+  {
+    if (isConversionReady())
+    {
+      return true;
+    }
+  }
+  // One last check, the loop may have been preempted right before the end of the conversion
+  return isConversionReady();
+}
+
+/**
+   @brief Worst-case time of a single-shot conversion
+          Decoded from the DR bits of the config word and the DR_SEL bit of the last written Config1 value
+   @param data  the config data
+   @return conversion time in us including oscillator tolerance and start-up time
+ **/
+uint32_t RAK_ADC_SGM58031::getConversionTime(uint16_t data)
+{
+  uint32_t period = getSamplePeriod(data);
+  return period + period * SGM58031_CONV_TOLERANCE / 100 + SGM58031_WAKEUP_TIME;
+}
+
+/**
+   @brief Start continuous conversion
+          The latest conversion result is collected into the sample ring buffer by serviceContinuous()
+          If a ready pin is used, ALERT/RDY pulses at the end of each conversion. The pulse is too short
+          to be polled, attach an interrupt on the FALLING edge of the pin that calls conversionReady()
+   @param data  the config data, the MODE bit is cleared automatically
+ **/
+void RAK_ADC_SGM58031::startContinuous(uint16_t data)
+{
+  _contConfig = data & ~(SGM58031_CONFIG_MODE | SGM58031_CONFIG_OS);
+  if (_readyPin >= 0)
+  {
+    _contConfig &= ~SGM58031_CONFIG_COMP_QUE;
+  }
+  _samplePeriod = getSamplePeriod(_contConfig);
+  _ringHead = 0;
+  _ringCount = 0;
+  _samplesLost = 0;
+  _readyEdges = 0;
+  _readyHandled = 0;
+  setConfig(_contConfig);
+  // First result is available one conversion period after the start, read with a quarter period margin
+  _nextSample = micros() + _samplePeriod + (_samplePeriod >> 2);
+  _continuous = true;
+}
+
+/**
+   @brief Stop continuous conversion
+          The ADC goes back to single-shot mode and powers down
+ **/
+void RAK_ADC_SGM58031::stopContinuous()
+{
+  if (!_continuous)
+  {
+    return;
+  }
+  _continuous = false;
+  setConfig(_contConfig | SGM58031_CONFIG_MODE);
+}
+
+/**
+   @brief Check if continuous conversion is running
+   @return true if continuous conversion is running
+ **/
+bool RAK_ADC_SGM58031::isContinuous()
+{
+  return _continuous;
+}
+
+/**
+   @brief Count the end of a conversion, call from the FALLING edge interrupt of the ALERT/RDY pin
+ **/
+void RAK_ADC_SGM58031::conversionReady()
+{
+  _readyEdges++;
+}
+
+/**
+   @brief Collect the latest conversion result if a new one is available
+          With a ready pin, a new result is detected from the edges counted by conversionReady(), edges that
+          arrived since the last call except the latest one are lost conversions.
+          Without ready pin, a new result is assumed every nominal conversion period. The oscillator of the
+          SGM58031 has a tolerance of +-10 %, samples can then be repeated or skipped and the lost count is an estimate
+          Must be called at least once per conversion period, otherwise samples are lost
+   @return number of samples added to the ring buffer (0 or 1)
+ **/
+uint16_t RAK_ADC_SGM58031::serviceContinuous()
+{
+  if (!_continuous)
+  {
+    return 0;
+  }
+  if (_readyPin >= 0)
+  {
+    // 16 bit read, atomic on the 32 bit MCUs
+    uint16_t edges = _readyEdges;
+    uint16_t pending = edges - _readyHandled;
+    if (pending == 0)
+    {
+      return 0;
+    }
+    // The conversion register holds only the latest result
+    _samplesLost += pending - 1;
+    _readyHandled = edges;
+    pushSample(getAdcValue());
+    return 1;
+  }
+  uint32_t elapsed = micros() - _nextSample;
+  if ((int32_t)elapsed < 0)
+  {
+    return 0;
+  }
+  // Conversions that were overwritten before we came here are lost
+  uint32_t missed = elapsed / _samplePeriod;
+  _samplesLost += missed;
+  _nextSample += (missed + 1) * _samplePeriod;
+  pushSample(getAdcValue());
+  return 1;
+}
+
+/**
+   @brief Copy the raw samples collected since the last call, oldest first
+   @param buffer  destination buffer
+   @param max_samples  size of the destination buffer
+   @return number of samples copied
+ **/
+uint16_t RAK_ADC_SGM58031::readSamples(uint16_t *buffer, uint16_t max_samples)
+{
+  uint16_t count = _ringCount < max_samples ? _ringCount : max_samples;
+  uint16_t tail = (_ringHead + SGM58031_RING_SIZE - _ringCount) % SGM58031_RING_SIZE;
+  for (uint16_t idx = 0; idx < count; idx++)
+  {
+    buffer[idx] = _ring[tail];
+    tail = (tail + 1) % SGM58031_RING_SIZE;
+  }
+  _ringCount -= count;
+  return count;
+}
+
+/**
+   @brief Get the number of samples lost since continuous conversion was started
+   @return lost samples, by ring buffer overflow or by late calls of serviceContinuous()
+ **/
+uint16_t RAK_ADC_SGM58031::getSamplesLost()
+{
+  return _samplesLost;
+}
+
+/**
+   @brief Nominal conversion period for the data rate bits of a config word and the DR_SEL bit of Config1
+          If Config1 was not written since the last resetShadow() the reset value (DR_SEL = 0) is assumed
+   @param data  the config data
+   @return conversion period in us
+ **/
+uint32_t RAK_ADC_SGM58031::getSamplePeriod(uint16_t data)
+{
+  // DR_SEL = 0: 6.25, 12.5, 25, 50, 100, 200, 400 and 800 SPS
+  static const uint32_t period_us[8] = {160000, 80000, 40000, 20000, 10000, 5000, 2500, 1250};
+  // DR_SEL = 1: 7.5, 15, 30, 60, 120, 240, 480 and 960 SPS
+  static const uint32_t period_sel_us[8] = {133334, 66667, 33334, 16667, 8334, 4167, 2084, 1042};
+  uint8_t rate = (data & SGM58031_CONFIG_DR) >> 5;
+  if ((_shadowValid & (1 << SGM58031_CONFIG1_REGISTER)) && (_shadow[SGM58031_CONFIG1_REGISTER] & SGM58031_CONFIG1_DR_SEL))
+  {
+    return period_sel_us[rate];
+  }
+  return period_us[rate];
+}
+
+/**
+   @brief Add a sample to the ring buffer, the oldest sample is overwritten if the buffer is full
+   @param value  raw conversion result
+ **/
+void RAK_ADC_SGM58031::pushSample(uint16_t value)
+{
+  _ring[_ringHead] = value;
+  _ringHead = (_ringHead + 1) % SGM58031_RING_SIZE;
+  if (_ringCount < SGM58031_RING_SIZE)
+  {
+    _ringCount++;
+  }
+  else
+  {
+    _samplesLost++;
+  }
+}
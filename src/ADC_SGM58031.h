@@ -33,6 +33,80 @@
 #define SGM58031_CHIP_ID_REGISTER (0x05)
 #define SGM58031_GN_TRIM1_REGISTER (0x06)
 
+// CONFIG REGISTER BITS
+#define SGM58031_CONFIG_OS (0x8000)        // write: start single conversion, read: 1 = no conversion in progress
+#define SGM58031_CONFIG_PGA (0x0E00)       // programmable gain amplifier, full scale range
+#define SGM58031_CONFIG_MODE (0x0100)      // 1 = single-shot / power-down, 0 = continuous conversion
+#define SGM58031_CONFIG_DR (0x00E0)        // data rate
+#define SGM58031_CONFIG_COMP_MODE (0x0010) // 1 = window comparator, 0 = traditional comparator
+#define SGM58031_CONFIG_COMP_POL (0x0008)  // 1 = ALERT/RDY active high, 0 = active low
+#define SGM58031_CONFIG_COMP_LAT (0x0004)  // 1 = latching comparator, cleared by reading the conversion register
+#define SGM58031_CONFIG_COMP_QUE (0x0003)  // comparator queue, 11 = comparator and ALERT/RDY disabled
+
+// FULL SCALE RANGE (config register PGA bits)
+#define SGM58031_PGA_6_144 (0x0000) // +/-6.144V
+#define SGM58031_PGA_4_096 (0x0200) // +/-4.096V
+#define SGM58031_PGA_2_048 (0x0400) // +/-2.048V
+#define SGM58031_PGA_1_024 (0x0600) // +/-1.024V
+#define SGM58031_PGA_0_512 (0x0800) // +/-0.512V
+#define SGM58031_PGA_0_256 (0x0A00) // +/-0.256V, 0x0C00 and 0x0E00 select the same range
+#define SGM58031_PGA_STEP (0x0200)  // next smaller full scale range
+
+// DATA RATE (config register DR bits, Config1 DR_SEL = 0)
+#define SGM58031_DR_6_25 (0x0000) // 6.25 SPS
+#define SGM58031_DR_12_5 (0x0020) // 12.5 SPS
+#define SGM58031_DR_25 (0x0040)   // 25 SPS
+#define SGM58031_DR_50 (0x0060)   // 50 SPS
+#define SGM58031_DR_100 (0x0080)  // 100 SPS
+#define SGM58031_DR_200 (0x00A0)  // 200 SPS
+#define SGM58031_DR_400 (0x00C0)  // 400 SPS
+#define SGM58031_DR_800 (0x00E0)  // 800 SPS
+
+// CONFIG1 REGISTER BITS
+#define SGM58031_CONFIG1_DR_SEL (0x0080)  // 1 = data rate table 7.5 ... 960 SPS, 0 = 6.25 ... 800 SPS
+#define SGM58031_CONFIG1_EXT_REF (0x0008) // 1 = external reference on AIN3, gain trimmed with GN_Trim1
+
+// SAMPLE RATE CODES (DR bits in bits 2:0, bit 3 selects the Config1 DR_SEL table)
+#define SGM58031_SPS_6_25 (0x00) // 6.25 SPS
+#define SGM58031_SPS_12_5 (0x01) // 12.5 SPS
+#define SGM58031_SPS_25 (0x02)   // 25 SPS
+#define SGM58031_SPS_50 (0x03)   // 50 SPS
+#define SGM58031_SPS_100 (0x04)  // 100 SPS
+#define SGM58031_SPS_200 (0x05)  // 200 SPS
+#define SGM58031_SPS_400 (0x06)  // 400 SPS
+#define SGM58031_SPS_800 (0x07)  // 800 SPS
+#define SGM58031_SPS_7_5 (0x08)  // 7.5 SPS
+#define SGM58031_SPS_15 (0x09)   // 15 SPS
+#define SGM58031_SPS_30 (0x0A)   // 30 SPS
+#define SGM58031_SPS_60 (0x0B)   // 60 SPS
+#define SGM58031_SPS_120 (0x0C)  // 120 SPS
+#define SGM58031_SPS_240 (0x0D)  // 240 SPS
+#define SGM58031_SPS_480 (0x0E)  // 480 SPS
+#define SGM58031_SPS_960 (0x0F)  // 960 SPS
+#define SGM58031_SPS_DR_SEL (0x08)
+#define SGM58031_SPS_NUM 16
+
+// ALERT/RDY as conversion ready pin (Hi_thresh MSB = 1, Lo_thresh MSB = 0)
+#define SGM58031_RDY_HIGH_THRESH (0x8000)
+#define SGM58031_RDY_LOW_THRESH (0x0000)
+
+// Conversion ready timeout in ms, longer than the slowest conversion (6.25 SPS)
+#define SGM58031_CONV_TIMEOUT 200
+// Tolerance of the internal oscillator in percent, added to the conversion time
+#define SGM58031_CONV_TOLERANCE 10
+// Start-up time from power-down in us, added to the single-shot conversion time
+#define SGM58031_WAKEUP_TIME 100
+
+// Register pointer not known, e.g. after an I2C error
+#define SGM58031_POINTER_UNKNOWN (0xFF)
+// Registers with a shadow copy (conversion, config, thresholds, config1)
+#define SGM58031_SHADOW_SIZE (SGM58031_CONFIG1_REGISTER + 1)
+
+// Size of the continuous conversion sample ring buffer (raw samples)
+#ifndef SGM58031_RING_SIZE
+#define SGM58031_RING_SIZE 64
+#endif
+
 //PGA
 #define SGM58031_FS_6_144   6.144 
 #define SGM58031_FS_4_096   4.096
@@ -57,6 +131,7 @@ public:
   uint8_t writeWordRegister(uint8_t reg, uint16_t data);
   uint8_t readByteRegister(uint8_t reg);
   uint16_t readWordRegister(uint8_t reg);
+  void resetShadow(); // forget register shadow copies, required after the ADC was powered down
 
   void setAlertLowThreshold(uint16_t threshold);  // Sets the lower limit threshold used to determine the alert condition
   uint16_t readAlertLowThreshold();               // read the lower limit threshold from register
@@ -68,19 +143,75 @@ public:
   void setConfig1(uint16_t data);
   uint16_t getConfig1();
 
+  // Typed Config1 access, read-modify-write of the single bits
+  void setDataRateSelect(bool alternate);   // Config1 DR_SEL, true = 7.5 ... 960 SPS, false = 6.25 ... 800 SPS
+  bool getDataRateSelect();
+  void setExternalReference(bool enable);   // Config1 EXT_REF, true = external reference on AIN3
+  bool getExternalReference();
+  uint16_t selectSampleRate(uint8_t rate);  // set DR_SEL for a SGM58031_SPS_xxx code, returns the DR bits for the config word
+  static float getSampleRate(uint8_t rate); // samples per second of a SGM58031_SPS_xxx code
+
   uint16_t getChipID();
   void set_GN_Trim1(uint16_t data);
   uint16_t get_GN_Trim1();
   uint16_t getAdcValue();
 
+  // Conversion ready handling
+  void setReadyPin(int pin);                                          // use ALERT/RDY pin for conversion ready, -1 to poll the OS bit
+  void startConversion(uint16_t data);                                // write config and start a single-shot conversion
+  bool isConversionReady();                                           // true if no conversion is in progress
+  bool waitConversionReady(uint16_t timeout = 0);                     // wait until conversion is done or timeout in ms, 0 = worst-case conversion time
+  uint32_t getConversionTime(uint16_t data);                          // worst-case single-shot conversion time in us for a config word
+
+  // Continuous conversion streaming
+  void startContinuous(uint16_t data);                          // start continuous conversion with the given config
+  void stopContinuous();                                        // stop continuous conversion, back to single-shot power-down
+  bool isContinuous();                                          // true if continuous conversion is running
+  uint16_t serviceContinuous();                                 // collect the latest sample when due, call frequently from loop
+  void conversionReady();                                       // count an ALERT/RDY falling edge, call from the interrupt handler
+  uint16_t readSamples(uint16_t *buffer, uint16_t max_samples); // copy the raw samples collected since the last call
+  uint16_t getSamplesLost();                                    // samples lost by ring buffer overflow or late service calls
+
   // Functions to set and get values
   void setVoltageResolution(float value); // the _VOLT_RESOLUTION default is 5.0V if3.3V use 3.3
   float getVoltageResolution();           // readback the ReferenceVoltage
   float getVoltage();
+  float rawToVoltage(int16_t raw);        // convert a raw conversion result to voltage
+  static uint16_t getPgaBits(float full_scale); // PGA bits for a full scale range SGM58031_FS_6_144 ... SGM58031_FS_0_256
+  static float getFullScale(uint16_t data);     // full scale range in volt of the PGA bits of a config word
+  static int32_t rawToMicrovolt(int16_t raw, uint16_t data); // integer conversion to uV for the PGA bits of a config word
 
 private:
   TwoWire *_wire;
   int i2cAddress;
   float ReferenceVoltage = 3.3; // if referencevoltage 5V use 5.0
+  int _readyPin = -1;           // ALERT/RDY pin, -1 if not used
+
+  uint8_t writeShadowedRegister(uint8_t reg, uint16_t data); // write only if different from the shadow copy
+  void setPointer(uint8_t reg);                               // set the register pointer if it changed
+  void updateConfig1(uint16_t mask, uint16_t value);         // change bits of Config1, other bits are kept
+  bool getConfig1Bit(uint16_t mask);                          // Config1 bit from the shadow copy or the chip
+
+  uint8_t _pointer = SGM58031_POINTER_UNKNOWN; // current register pointer of the chip
+  uint16_t _shadow[SGM58031_SHADOW_SIZE];      // last written register values
+  uint8_t _shadowValid = 0;                    // bit n set if _shadow[n] is valid
+
+  uint32_t getSamplePeriod(uint16_t data); // conversion period in us for the data rate in a config word
+  void pushSample(uint16_t value);
+
+  uint32_t _convStart = 0;  // micros() when the last single-shot conversion was started
+  uint32_t _convMin = 0;    // earliest end of the last conversion in us, the OS bit is not polled before
+  uint32_t _convTime = 0;   // worst-case time of the last conversion in us
+
+  bool _continuous = false;              // continuous conversion running
+  uint16_t _contConfig = 0;              // config used for continuous conversion
+  uint32_t _samplePeriod = 0;            // conversion period in us
+  uint32_t _nextSample = 0;              // micros() timestamp when the next sample is due, without ready pin
+  volatile uint16_t _readyEdges = 0;     // ALERT/RDY edges counted by conversionReady()
+  uint16_t _readyHandled = 0;            // edges handled by serviceContinuous()
+  uint16_t _samplesLost = 0;             // lost samples counter
+  uint16_t _ring[SGM58031_RING_SIZE];    // raw sample ring buffer
+  uint16_t _ringHead = 0;                // next write position
+  uint16_t _ringCount = 0;               // number of samples in the ring buffer
 };
 #endif
@@ -76,6 +76,10 @@ Modbus::Modbus(uint8_t u8id, Stream &port, uint8_t u8txenpin)
 	this->u8txenpin = u8txenpin;
 	this->u16timeOut = 1000;
 	this->u32overTime = 0;
+	this->u16RxCRC = 0xFFFF;
+	this->u8queryId = 0;
+	this->u8queryFct = 0;
+	this->u16queryCoilsNo = 0;
 }
 
 void Modbus::setUART(Stream &port)
@@ -105,7 +109,7 @@ void Modbus::start()
 
 	while (port->read() >= 0)
 		;
-	u8lastRec = u8BufferSize = 0;
+	u16lastRec = u16BufferSize = 0;
 	u16InCnt = u16OutCnt = u16errCnt = 0;
 }
 
@@ -258,7 +262,7 @@ uint8_t Modbus::getLastError()
  */
 int8_t Modbus::query(modbus_t telegram)
 {
-	uint8_t u8regsno, u8bytesno;
+	uint16_t u16regsno, u16bytesno;
 	if (u8id != 0)
 		return -2;
 	if (u8state != COM_IDLE)
@@ -267,7 +271,23 @@ int8_t Modbus::query(modbus_t telegram)
 	if ((telegram.u8id == 0) || (telegram.u8id > 247))
 		return -3;
 
+	// the response must fit into the buffer
+	if ((telegram.u8fct == MB_FC_READ_COILS) || (telegram.u8fct == MB_FC_READ_DISCRETE_INPUT))
+	{
+		if ((telegram.u16CoilsNo == 0) || (telegram.u16CoilsNo > 2000) || (3 + (telegram.u16CoilsNo + 7) / 8 + 2 > MAX_BUFFER))
+			return ERR_BUFF_OVERFLOW;
+	}
+	if ((telegram.u8fct == MB_FC_READ_REGISTERS) || (telegram.u8fct == MB_FC_READ_INPUT_REGISTER))
+	{
+		if ((telegram.u16CoilsNo == 0) || (telegram.u16CoilsNo > 125) || (3 + telegram.u16CoilsNo * 2 + 2 > MAX_BUFFER))
+			return ERR_BUFF_OVERFLOW;
+	}
+
 	au16regs = telegram.au16reg;
+	// kept to check the answer
+	u8queryId = telegram.u8id;
+	u8queryFct = telegram.u8fct;
+	u16queryCoilsNo = telegram.u16CoilsNo;
 
 	// telegram header
 	au8Buffer[ID] = telegram.u8id;
@@ -283,58 +303,64 @@ int8_t Modbus::query(modbus_t telegram)
 	case MB_FC_READ_INPUT_REGISTER:
 		au8Buffer[NB_HI] = highByte(telegram.u16CoilsNo);
 		au8Buffer[NB_LO] = lowByte(telegram.u16CoilsNo);
-		u8BufferSize = 6;
+		u16BufferSize = 6;
 		break;
 	case MB_FC_WRITE_COIL:
 		au8Buffer[NB_HI] = ((au16regs[0] > 0) ? 0xff : 0);
 		au8Buffer[NB_LO] = 0;
-		u8BufferSize = 6;
+		u16BufferSize = 6;
 		break;
 	case MB_FC_WRITE_REGISTER:
 		au8Buffer[NB_HI] = highByte(au16regs[0]);
 		au8Buffer[NB_LO] = lowByte(au16regs[0]);
-		u8BufferSize = 6;
+		u16BufferSize = 6;
 		break;
 	case MB_FC_WRITE_MULTIPLE_COILS: // TODO: implement "sending coils"
-		u8regsno = telegram.u16CoilsNo / 16;
-		u8bytesno = u8regsno * 2;
+		// header, data and CRC must fit into the buffer
+		if ((telegram.u16CoilsNo > 1968) || (7 + (telegram.u16CoilsNo + 15) / 16 * 2 + 2 > MAX_BUFFER))
+			return ERR_BUFF_OVERFLOW;
+		u16regsno = telegram.u16CoilsNo / 16;
+		u16bytesno = u16regsno * 2;
 		if ((telegram.u16CoilsNo % 16) != 0)
 		{
-			u8bytesno++;
-			u8regsno++;
+			u16bytesno++;
+			u16regsno++;
 		}
 
 		au8Buffer[NB_HI] = highByte(telegram.u16CoilsNo);
 		au8Buffer[NB_LO] = lowByte(telegram.u16CoilsNo);
-		au8Buffer[BYTE_CNT] = u8bytesno;
-		u8BufferSize = 7;
+		au8Buffer[BYTE_CNT] = (uint8_t)u16bytesno;
+		u16BufferSize = 7;
 
-		for (uint16_t i = 0; i < u8bytesno; i++)
+		for (uint16_t i = 0; i < u16bytesno; i++)
 		{
 			if (i % 2)
 			{
-				au8Buffer[u8BufferSize] = lowByte(au16regs[i / 2]);
+				au8Buffer[u16BufferSize] = lowByte(au16regs[i / 2]);
 			}
 			else
 			{
-				au8Buffer[u8BufferSize] = highByte(au16regs[i / 2]);
+				au8Buffer[u16BufferSize] = highByte(au16regs[i / 2]);
 			}
-			u8BufferSize++;
+			u16BufferSize++;
 		}
 		break;
 
 	case MB_FC_WRITE_MULTIPLE_REGISTERS:
+		// header, data and CRC must fit into the buffer
+		if ((telegram.u16CoilsNo > 123) || (7 + telegram.u16CoilsNo * 2 + 2 > MAX_BUFFER))
+			return ERR_BUFF_OVERFLOW;
 		au8Buffer[NB_HI] = highByte(telegram.u16CoilsNo);
 		au8Buffer[NB_LO] = lowByte(telegram.u16CoilsNo);
 		au8Buffer[BYTE_CNT] = (uint8_t)(telegram.u16CoilsNo * 2);
-		u8BufferSize = 7;
+		u16BufferSize = 7;
 
 		for (uint16_t i = 0; i < telegram.u16CoilsNo; i++)
 		{
-			au8Buffer[u8BufferSize] = highByte(au16regs[i]);
-			u8BufferSize++;
-			au8Buffer[u8BufferSize] = lowByte(au16regs[i]);
-			u8BufferSize++;
+			au8Buffer[u16BufferSize] = highByte(au16regs[i]);
+			u16BufferSize++;
+			au8Buffer[u16BufferSize] = lowByte(au16regs[i]);
+			u16BufferSize++;
 		}
 		break;
 	}
@@ -359,11 +385,11 @@ int8_t Modbus::query(modbus_t telegram)
  * @return errors counter
  * @ingroup loop
  */
-int8_t Modbus::poll()
+int16_t Modbus::poll()
 {
 	// check if there is any incoming frame
-	uint8_t u8current;
-	u8current = port->available();
+	uint16_t u16current;
+	u16current = port->available();
 
 	if ((unsigned long)(millis() - u32timeOut) > (unsigned long)u16timeOut)
 	{
@@ -373,13 +399,13 @@ int8_t Modbus::poll()
 		return 0;
 	}
 
-	if (u8current == 0)
+	if (u16current == 0)
 		return 0;
 
 	// check T35 after frame end or still no frame end
-	if (u8current != u8lastRec)
+	if (u16current != u16lastRec)
 	{
-		u8lastRec = u8current;
+		u16lastRec = u16current;
 		u32time = millis();
 		return 0;
 	}
@@ -387,21 +413,28 @@ int8_t Modbus::poll()
 		return 0;
 
 	// transfer Serial buffer frame to auBuffer
-	u8lastRec = 0;
-	int8_t i8state = getRxBuffer();
-	if (i8state < 6) // 7 was incorrect for functions 1 and 2 the smallest frame could be 6 bytes long
+	u16lastRec = 0;
+	int16_t i16state = getRxBuffer();
+	// 7 was incorrect for functions 1 and 2 the smallest frame could be 6 bytes long
+	// an exception response is only 5 bytes long
+	if ((i16state < 6) && !((i16state == 5) && ((au8Buffer[FUNC] & 0x80) != 0)))
 	{
 		u8state = COM_IDLE;
 		u16errCnt++;
-		return i8state;
+		return i16state;
 	}
 
 	// validate message: id, CRC, FCT, exception
 	uint8_t u8exception = validateAnswer();
 	if (u8exception != 0)
 	{
+		if ((int8_t)u8exception == ERR_EXCEPTION)
+		{
+			// keep the exception code of the slave
+			u8lastError = au8Buffer[2];
+		}
 		u8state = COM_IDLE;
-		return u8exception;
+		return (int8_t)u8exception;
 	}
 
 	// process answer
@@ -427,7 +460,7 @@ int8_t Modbus::poll()
 		break;
 	}
 	u8state = COM_IDLE;
-	return u8BufferSize;
+	return u16BufferSize;
 }
 
 /**
@@ -443,34 +476,34 @@ int8_t Modbus::poll()
  * @return 0 if no query, 1..4 if communication error, >4 if correct query processed
  * @ingroup loop
  */
-int8_t Modbus::poll(int16_t *regs, uint8_t u8size)
+int16_t Modbus::poll(int16_t *regs, uint8_t u8size)
 {
 
 	au16regs = regs;
 	u8regsize = u8size;
-	uint8_t u8current;
+	uint16_t u16current;
 
 	// check if there is any incoming frame
-	u8current = port->available();
+	u16current = port->available();
 
-	if (u8current == 0)
+	if (u16current == 0)
 		return 0;
 
 	// check T35 after frame end or still no frame end
-	if (u8current != u8lastRec)
+	if (u16current != u16lastRec)
 	{
-		u8lastRec = u8current;
+		u16lastRec = u16current;
 		u32time = millis();
 		return 0;
 	}
 	if ((unsigned long)(millis() - u32time) < (unsigned long)T35)
 		return 0;
 
-	u8lastRec = 0;
-	int8_t i8state = getRxBuffer();
-	u8lastError = i8state;
-	if (i8state < 7)
-		return i8state;
+	u16lastRec = 0;
+	int16_t i16state = getRxBuffer();
+	u8lastError = i16state;
+	if (i16state < 7)
+		return i16state;
 
 	// check slave id
 	if (au8Buffer[ID] != u8id)
@@ -486,7 +519,7 @@ int8_t Modbus::poll(int16_t *regs, uint8_t u8size)
 			sendTxBuffer();
 		}
 		u8lastError = u8exception;
-		return u8exception;
+		return (int8_t)u8exception;
 	}
 
 	u32timeOut = millis();
@@ -518,7 +551,7 @@ int8_t Modbus::poll(int16_t *regs, uint8_t u8size)
 	default:
 		break;
 	}
-	return i8state;
+	return i16state;
 }
 
 /* _____PRIVATE FUNCTIONS_____________________________________________________ */
@@ -527,24 +560,31 @@ int8_t Modbus::poll(int16_t *regs, uint8_t u8size)
  * @brief
  * This method moves Serial buffer data to the Modbus au8Buffer.
  *
- * @return buffer size if OK, ERR_BUFF_OVERFLOW if u8BufferSize >= MAX_BUFFER
+ * @return buffer size if OK, ERR_BUFF_OVERFLOW if u16BufferSize >= MAX_BUFFER
  * @ingroup buffer
  */
-int8_t Modbus::getRxBuffer()
+int16_t Modbus::getRxBuffer()
 {
 	boolean bBuffOverflow = false;
 
 	if (u8txenpin > 1)
 		digitalWrite(u8txenpin, LOW);
 
-	u8BufferSize = 0;
+	u16BufferSize = 0;
+	u16RxCRC = 0xFFFF;
 	while (port->available())
 	{
-		au8Buffer[u8BufferSize] = port->read();
-		u8BufferSize++;
-
-		if (u8BufferSize >= MAX_BUFFER)
+		uint8_t u8data = port->read();
+		if (u16BufferSize >= MAX_BUFFER)
+		{
+			// drain the rest of the frame
 			bBuffOverflow = true;
+			continue;
+		}
+		au8Buffer[u16BufferSize] = u8data;
+		u16BufferSize++;
+		// CRC is accumulated per byte, the frame check is a compare at the end
+		u16RxCRC = updateCRC(u16RxCRC, u8data);
 	}
 	u16InCnt++;
 
@@ -553,7 +593,7 @@ int8_t Modbus::getRxBuffer()
 		u16errCnt++;
 		return ERR_BUFF_OVERFLOW;
 	}
-	return u8BufferSize;
+	return u16BufferSize;
 }
 
 /**
@@ -570,12 +610,12 @@ int8_t Modbus::getRxBuffer()
  */
 void Modbus::sendTxBuffer()
 {
-	// append CRC to message
-	uint16_t u16crc = calcCRC(u8BufferSize);
-	au8Buffer[u8BufferSize] = u16crc >> 8;
-	u8BufferSize++;
-	au8Buffer[u8BufferSize] = u16crc & 0x00ff;
-	u8BufferSize++;
+	// append CRC to message, crcLo byte is first & crcHi byte is last
+	uint16_t u16crc = calcCRC(au8Buffer, u16BufferSize);
+	au8Buffer[u16BufferSize] = u16crc & 0x00ff;
+	u16BufferSize++;
+	au8Buffer[u16BufferSize] = u16crc >> 8;
+	u16BufferSize++;
 
 	if (u8txenpin > 1)
 	{
@@ -584,7 +624,7 @@ void Modbus::sendTxBuffer()
 	}
 
 	// transfer buffer to serial line
-	port->write(au8Buffer, u8BufferSize);
+	port->write(au8Buffer, u16BufferSize);
 
 	if (u8txenpin > 1)
 	{
@@ -602,7 +642,7 @@ void Modbus::sendTxBuffer()
 	while (port->read() >= 0)
 		;
 
-	u8BufferSize = 0;
+	u16BufferSize = 0;
 
 	// set time-out for master
 	u32timeOut = millis();
@@ -611,35 +651,86 @@ void Modbus::sendTxBuffer()
 	u16OutCnt++;
 }
 
+#if MODBUS_CRC_FULL_TABLE > 0
+/** CRC-16/Modbus (reflected polynomial 0xA001) of each byte value */
+static const uint16_t au16CRCTable[256] = {
+	0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+	0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+	0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+	0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+	0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+	0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+	0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+	0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+	0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+	0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+	0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+	0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+	0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+	0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+	0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+	0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+	0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+	0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+	0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+	0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+	0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+	0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+	0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+	0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+	0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+	0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+	0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+	0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+	0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+	0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+	0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+	0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040};
+#else
+/** CRC-16/Modbus (reflected polynomial 0xA001) of each nibble value */
+static const uint16_t au16CRCTable[16] = {
+	0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+	0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400};
+#endif
+
 /**
  * @brief
- * This method calculates CRC
+ * This method adds one byte to a CRC-16/Modbus
  *
- * @return uint16_t calculated CRC value for the message
+ * @param u16crc CRC of the previous bytes, 0xFFFF for the first byte
+ * @param u8data byte to add
+ * @return uint16_t CRC including the byte, low byte is sent first
  * @ingroup buffer
  */
-uint16_t Modbus::calcCRC(uint8_t u8length)
+uint16_t Modbus::updateCRC(uint16_t u16crc, uint8_t u8data)
 {
-	unsigned int temp, temp2, flag;
-	temp = 0xFFFF;
-	for (unsigned char i = 0; i < u8length; i++)
+#if MODBUS_CRC_FULL_TABLE > 0
+	return (u16crc >> 8) ^ au16CRCTable[(u16crc ^ u8data) & 0xFF];
+#else
+	u16crc ^= u8data;
+	u16crc = (u16crc >> 4) ^ au16CRCTable[u16crc & 0x0F];
+	return (u16crc >> 4) ^ au16CRCTable[u16crc & 0x0F];
+#endif
+}
+
+/**
+ * @brief
+ * This method calculates the CRC-16/Modbus of a buffer.
+ * A frame followed by its CRC (low byte first) gives 0.
+ *
+ * @param au8data data
+ * @param u16length number of bytes
+ * @param u16crc CRC of previous data, 0xFFFF to start a new CRC
+ * @return uint16_t CRC, low byte is sent first
+ * @ingroup buffer
+ */
+uint16_t Modbus::calcCRC(const uint8_t *au8data, uint16_t u16length, uint16_t u16crc)
+{
+	for (uint16_t i = 0; i < u16length; i++)
 	{
-		temp = temp ^ au8Buffer[i];
-		for (unsigned char j = 1; j <= 8; j++)
-		{
-			flag = temp & 0x0001;
-			temp >>= 1;
-			if (flag)
-				temp ^= 0xA001;
-		}
+		u16crc = updateCRC(u16crc, au8data[i]);
 	}
-	// Reverse byte order.
-	temp2 = temp >> 8;
-	temp = (temp << 8) | temp2;
-	temp &= 0xFFFF;
-	// the returned value is already swapped
-	// crcLo byte is first & crcHi byte is last
-	return temp;
+	return u16crc;
 }
 
 /**
@@ -651,10 +742,8 @@ uint16_t Modbus::calcCRC(uint8_t u8length)
  */
 uint8_t Modbus::validateRequest()
 {
-	// check message crc vs calculated crc
-	uint16_t u16MsgCRC =
-		((au8Buffer[u8BufferSize - 2] << 8) | au8Buffer[u8BufferSize - 1]); // combine the crc Low & High bytes
-	if (calcCRC(u8BufferSize - 2) != u16MsgCRC)
+	// check message crc, the CRC over the frame including its crc bytes is 0
+	if (u16RxCRC != 0)
 	{
 		u16errCnt++;
 		return NO_REPLY;
@@ -676,42 +765,57 @@ uint8_t Modbus::validateRequest()
 		return EXC_FUNC_CODE;
 	}
 
-	// check start address & nb range
-	uint16_t u16regs = 0;
-	uint8_t u8regs;
+	// check start address & nb range, 32 bit so that start + quantity cannot wrap
+	uint32_t u32start = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]);
+	uint32_t u32quantity = makeWord(au8Buffer[NB_HI], au8Buffer[NB_LO]);
 	switch (au8Buffer[FUNC])
 	{
 	case MB_FC_READ_COILS:
 	case MB_FC_READ_DISCRETE_INPUT:
 	case MB_FC_WRITE_MULTIPLE_COILS:
-		u16regs = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]) / 16;
-		u16regs += makeWord(au8Buffer[NB_HI], au8Buffer[NB_LO]) / 16;
-		u8regs = (uint8_t)u16regs;
-		if (u8regs > u8regsize)
+		// registers holding the coils start ... start + quantity - 1
+		if ((u32start + u32quantity + 15) / 16 > u8regsize)
 			return EXC_ADDR_RANGE;
 		break;
 	case MB_FC_WRITE_COIL:
-		u16regs = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]) / 16;
-		u8regs = (uint8_t)u16regs;
-		if (u8regs > u8regsize)
+		if (u32start / 16 >= u8regsize)
 			return EXC_ADDR_RANGE;
 		break;
 	case MB_FC_WRITE_REGISTER:
-		u16regs = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]);
-		u8regs = (uint8_t)u16regs;
-		if (u8regs > u8regsize)
+		if (u32start >= u8regsize)
 			return EXC_ADDR_RANGE;
 		break;
 	case MB_FC_READ_REGISTERS:
 	case MB_FC_READ_INPUT_REGISTER:
 	case MB_FC_WRITE_MULTIPLE_REGISTERS:
-		u16regs = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]);
-		u16regs += makeWord(au8Buffer[NB_HI], au8Buffer[NB_LO]);
-		u8regs = (uint8_t)u16regs;
-		if (u8regs > u8regsize)
+		if (u32start + u32quantity > u8regsize)
 			return EXC_ADDR_RANGE;
 		break;
 	}
+
+	// the data of a write request must be complete
+	if (au8Buffer[FUNC] == MB_FC_WRITE_MULTIPLE_COILS)
+	{
+		if ((u32quantity == 0) || (au8Buffer[BYTE_CNT] != (u32quantity + 7) / 8) || (u16BufferSize != 7 + au8Buffer[BYTE_CNT] + 2))
+			return EXC_REGS_QUANT;
+	}
+	if (au8Buffer[FUNC] == MB_FC_WRITE_MULTIPLE_REGISTERS)
+	{
+		if ((u32quantity == 0) || (au8Buffer[BYTE_CNT] != u32quantity * 2) || (u16BufferSize != 7 + au8Buffer[BYTE_CNT] + 2))
+			return EXC_REGS_QUANT;
+	}
+
+	// the response must fit into the buffer
+	if ((au8Buffer[FUNC] == MB_FC_READ_COILS) || (au8Buffer[FUNC] == MB_FC_READ_DISCRETE_INPUT))
+	{
+		if (3 + (u32quantity + 7) / 8 + 2 > MAX_BUFFER)
+			return EXC_REGS_QUANT;
+	}
+	if ((au8Buffer[FUNC] == MB_FC_READ_REGISTERS) || (au8Buffer[FUNC] == MB_FC_READ_INPUT_REGISTER))
+	{
+		if (3 + u32quantity * 2 + 2 > MAX_BUFFER)
+			return EXC_REGS_QUANT;
+	}
 	return 0; // OK, no exception code thrown
 }
 
@@ -724,10 +828,15 @@ uint8_t Modbus::validateRequest()
  */
 uint8_t Modbus::validateAnswer()
 {
-	// check message crc vs calculated crc
-	uint16_t u16MsgCRC =
-		((au8Buffer[u8BufferSize - 2] << 8) | au8Buffer[u8BufferSize - 1]); // combine the crc Low & High bytes
-	if (calcCRC(u8BufferSize - 2) != u16MsgCRC)
+	// check message crc, the CRC over the frame including its crc bytes is 0
+	if (u16RxCRC != 0)
+	{
+		u16errCnt++;
+		return NO_REPLY;
+	}
+
+	// check the answer comes from the queried slave for the queried function
+	if ((au8Buffer[ID] != u8queryId) || ((au8Buffer[FUNC] & 0x7f) != u8queryFct))
 	{
 		u16errCnt++;
 		return NO_REPLY;
@@ -756,6 +865,33 @@ uint8_t Modbus::validateAnswer()
 		return EXC_FUNC_CODE;
 	}
 
+	// check the byte count matches the query and the frame length
+	uint16_t u16bytesno;
+	switch (au8Buffer[FUNC])
+	{
+	case MB_FC_READ_COILS:
+	case MB_FC_READ_DISCRETE_INPUT:
+		u16bytesno = (u16queryCoilsNo + 7) / 8;
+		break;
+	case MB_FC_READ_REGISTERS:
+	case MB_FC_READ_INPUT_REGISTER:
+		u16bytesno = u16queryCoilsNo * 2;
+		break;
+	default:
+		// write answers are an echo of the 6 byte request header
+		if (u16BufferSize != RESPONSE_SIZE + 2)
+		{
+			u16errCnt++;
+			return NO_REPLY;
+		}
+		return 0;
+	}
+	if ((au8Buffer[2] != u16bytesno) || (u16BufferSize != 3 + u16bytesno + 2))
+	{
+		u16errCnt++;
+		return NO_REPLY;
+	}
+
 	return 0; // OK, no exception code thrown
 }
 
@@ -772,7 +908,7 @@ void Modbus::buildException(uint8_t u8exception)
 	au8Buffer[ID] = u8id;
 	au8Buffer[FUNC] = u8func + 0x80;
 	au8Buffer[2] = u8exception;
-	u8BufferSize = EXCEPTION_SIZE;
+	u16BufferSize = EXCEPTION_SIZE;
 }
 
 /**
@@ -784,19 +920,19 @@ void Modbus::buildException(uint8_t u8exception)
  */
 void Modbus::get_FC1()
 {
-	uint8_t u8byte, i;
-	u8byte = 3;
+	uint16_t u16byte, i;
+	u16byte = 3;
 	for (i = 0; i < au8Buffer[2]; i++)
 	{
 
 		if (i % 2)
 		{
-			au16regs[i / 2] = makeWord(au8Buffer[i + u8byte], lowByte(au16regs[i / 2]));
+			au16regs[i / 2] = makeWord(au8Buffer[i + u16byte], lowByte(au16regs[i / 2]));
 		}
 		else
 		{
 
-			au16regs[i / 2] = makeWord(highByte(au16regs[i / 2]), au8Buffer[i + u8byte]);
+			au16regs[i / 2] = makeWord(highByte(au16regs[i / 2]), au8Buffer[i + u16byte]);
 		}
 	}
 }
@@ -809,15 +945,15 @@ void Modbus::get_FC1()
  */
 void Modbus::get_FC3()
 {
-	uint8_t u8byte, i;
-	u8byte = 3;
+	uint16_t u16byte, i;
+	u16byte = 3;
 
 	for (i = 0; i < au8Buffer[2] / 2; i++)
 	{
 		au16regs[i] = makeWord(
-			au8Buffer[u8byte],
-			au8Buffer[u8byte + 1]);
-		u8byte += 2;
+			au8Buffer[u16byte],
+			au8Buffer[u16byte + 1]);
+		u16byte += 2;
 	}
 }
 
@@ -826,13 +962,14 @@ void Modbus::get_FC3()
  * This method processes functions 1 & 2
  * This method reads a bit array and transfers it to the master
  *
- * @return u8BufferSize Response to master length
+ * @return u16BufferSize Response to master length
  * @ingroup discrete
  */
-int8_t Modbus::process_FC1(int16_t *regs, uint8_t /*u8size*/)
+int16_t Modbus::process_FC1(int16_t *regs, uint8_t /*u8size*/)
 {
-	uint8_t u8currentRegister, u8currentBit, u8bytesno, u8bitsno;
-	uint8_t u8CopyBufferSize;
+	uint16_t u16currentRegister, u16bytesno;
+	uint8_t u8currentBit, u8bitsno;
+	uint16_t u16CopyBufferSize;
 	uint16_t u16currentCoil, u16coil;
 
 	// get the first and last coil from the message
@@ -840,12 +977,12 @@ int8_t Modbus::process_FC1(int16_t *regs, uint8_t /*u8size*/)
 	uint16_t u16Coilno = makeWord(au8Buffer[NB_HI], au8Buffer[NB_LO]);
 
 	// put the number of bytes in the outcoming message
-	u8bytesno = (uint8_t)(u16Coilno / 8);
+	u16bytesno = u16Coilno / 8;
 	if (u16Coilno % 8 != 0)
-		u8bytesno++;
-	au8Buffer[ADD_HI] = u8bytesno;
-	u8BufferSize = ADD_LO;
-	au8Buffer[u8BufferSize + u8bytesno - 1] = 0;
+		u16bytesno++;
+	au8Buffer[ADD_HI] = (uint8_t)u16bytesno;
+	u16BufferSize = ADD_LO;
+	au8Buffer[u16BufferSize + u16bytesno - 1] = 0;
 
 	// read each coil from the register map and put its value inside the outcoming message
 	u8bitsno = 0;
@@ -853,28 +990,28 @@ int8_t Modbus::process_FC1(int16_t *regs, uint8_t /*u8size*/)
 	for (u16currentCoil = 0; u16currentCoil < u16Coilno; u16currentCoil++)
 	{
 		u16coil = u16StartCoil + u16currentCoil;
-		u8currentRegister = (uint8_t)(u16coil / 16);
+		u16currentRegister = u16coil / 16;
 		u8currentBit = (uint8_t)(u16coil % 16);
 
 		bitWrite(
-			au8Buffer[u8BufferSize],
+			au8Buffer[u16BufferSize],
 			u8bitsno,
-			bitRead(regs[u8currentRegister], u8currentBit));
+			bitRead(regs[u16currentRegister], u8currentBit));
 		u8bitsno++;
 
 		if (u8bitsno > 7)
 		{
 			u8bitsno = 0;
-			u8BufferSize++;
+			u16BufferSize++;
 		}
 	}
 
 	// send outcoming message
 	if (u16Coilno % 8 != 0)
-		u8BufferSize++;
-	u8CopyBufferSize = u8BufferSize + 2;
+		u16BufferSize++;
+	u16CopyBufferSize = u16BufferSize + 2;
 	sendTxBuffer();
-	return u8CopyBufferSize;
+	return u16CopyBufferSize;
 }
 
 /**
@@ -882,31 +1019,31 @@ int8_t Modbus::process_FC1(int16_t *regs, uint8_t /*u8size*/)
  * This method processes functions 3 & 4
  * This method reads a makeWord array and transfers it to the master
  *
- * @return u8BufferSize Response to master length
+ * @return u16BufferSize Response to master length
  * @ingroup register
  */
-int8_t Modbus::process_FC3(int16_t *regs, uint8_t /*u8size*/)
+int16_t Modbus::process_FC3(int16_t *regs, uint8_t /*u8size*/)
 {
 
-	uint8_t u8StartAdd = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]);
-	uint8_t u8regsno = makeWord(au8Buffer[NB_HI], au8Buffer[NB_LO]);
-	uint8_t u8CopyBufferSize;
-	uint8_t i;
+	uint16_t u16StartAdd = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]);
+	uint16_t u16regsno = makeWord(au8Buffer[NB_HI], au8Buffer[NB_LO]);
+	uint16_t u16CopyBufferSize;
+	uint16_t i;
 
-	au8Buffer[2] = u8regsno * 2;
-	u8BufferSize = 3;
+	au8Buffer[2] = (uint8_t)(u16regsno * 2);
+	u16BufferSize = 3;
 
-	for (i = u8StartAdd; i < u8StartAdd + u8regsno; i++)
+	for (i = u16StartAdd; i < u16StartAdd + u16regsno; i++)
 	{
-		au8Buffer[u8BufferSize] = highByte(regs[i]);
-		u8BufferSize++;
-		au8Buffer[u8BufferSize] = lowByte(regs[i]);
-		u8BufferSize++;
+		au8Buffer[u16BufferSize] = highByte(regs[i]);
+		u16BufferSize++;
+		au8Buffer[u16BufferSize] = lowByte(regs[i]);
+		u16BufferSize++;
 	}
-	u8CopyBufferSize = u8BufferSize + 2;
+	u16CopyBufferSize = u16BufferSize + 2;
 	sendTxBuffer();
 
-	return u8CopyBufferSize;
+	return u16CopyBufferSize;
 }
 
 /**
@@ -914,31 +1051,32 @@ int8_t Modbus::process_FC3(int16_t *regs, uint8_t /*u8size*/)
  * This method processes function 5
  * This method writes a value assigned by the master to a single bit
  *
- * @return u8BufferSize Response to master length
+ * @return u16BufferSize Response to master length
  * @ingroup discrete
  */
-int8_t Modbus::process_FC5(int16_t *regs, uint8_t /*u8size*/)
+int16_t Modbus::process_FC5(int16_t *regs, uint8_t /*u8size*/)
 {
-	uint8_t u8currentRegister, u8currentBit;
-	uint8_t u8CopyBufferSize;
+	uint16_t u16currentRegister;
+	uint8_t u8currentBit;
+	uint16_t u16CopyBufferSize;
 	uint16_t u16coil = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]);
 
 	// point to the register and its bit
-	u8currentRegister = (uint8_t)(u16coil / 16);
+	u16currentRegister = u16coil / 16;
 	u8currentBit = (uint8_t)(u16coil % 16);
 
 	// write to coil
 	bitWrite(
-		regs[u8currentRegister],
+		regs[u16currentRegister],
 		u8currentBit,
 		au8Buffer[NB_HI] == 0xff);
 
 	// send answer to master
-	u8BufferSize = 6;
-	u8CopyBufferSize = u8BufferSize + 2;
+	u16BufferSize = 6;
+	u16CopyBufferSize = u16BufferSize + 2;
 	sendTxBuffer();
 
-	return u8CopyBufferSize;
+	return u16CopyBufferSize;
 }
 
 /**
@@ -946,25 +1084,25 @@ int8_t Modbus::process_FC5(int16_t *regs, uint8_t /*u8size*/)
  * This method processes function 6
  * This method writes a value assigned by the master to a single makeWord
  *
- * @return u8BufferSize Response to master length
+ * @return u16BufferSize Response to master length
  * @ingroup register
  */
-int8_t Modbus::process_FC6(int16_t *regs, uint8_t /*u8size*/)
+int16_t Modbus::process_FC6(int16_t *regs, uint8_t /*u8size*/)
 {
 
-	uint8_t u8add = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]);
-	uint8_t u8CopyBufferSize;
+	uint16_t u16add = makeWord(au8Buffer[ADD_HI], au8Buffer[ADD_LO]);
+	uint16_t u16CopyBufferSize;
 	uint16_t u16val = makeWord(au8Buffer[NB_HI], au8Buffer[NB_LO]);
 
-	regs[u8add] = u16val;
+	regs[u16add] = u16val;
 
 	// keep the same header
-	u8BufferSize = RESPONSE_SIZE;
+	u16BufferSize = RESPONSE_SIZE;
 
-	u8CopyBufferSize = u8BufferSize + 2;
+	u16CopyBufferSize = u16BufferSize + 2;
 	sendTxBuffer();
 
-	return u8CopyBufferSize;
+	return u16CopyBufferSize;
 }
 
 /**
@@ -972,13 +1110,14 @@ int8_t Modbus::process_FC6(int16_t *regs, uint8_t /*u8size*/)
  * This method processes function 15
  * This method writes a bit array assigned by the master
  *
- * @return u8BufferSize Response to master length
+ * @return u16BufferSize Response to master length
  * @ingroup discrete
  */
-int8_t Modbus::process_FC15(int16_t *regs, uint8_t /*u8size*/)
+int16_t Modbus::process_FC15(int16_t *regs, uint8_t /*u8size*/)
 {
-	uint8_t u8currentRegister, u8currentBit, u8frameByte, u8bitsno;
-	uint8_t u8CopyBufferSize;
+	uint16_t u16currentRegister, u16frameByte;
+	uint8_t u8currentBit, u8bitsno;
+	uint16_t u16CopyBufferSize;
 	uint16_t u16currentCoil, u16coil;
 	boolean bTemp;
 
@@ -988,20 +1127,20 @@ int8_t Modbus::process_FC15(int16_t *regs, uint8_t /*u8size*/)
 
 	// read each coil from the register map and put its value inside the outcoming message
 	u8bitsno = 0;
-	u8frameByte = 7;
+	u16frameByte = 7;
 	for (u16currentCoil = 0; u16currentCoil < u16Coilno; u16currentCoil++)
 	{
 
 		u16coil = u16StartCoil + u16currentCoil;
-		u8currentRegister = (uint8_t)(u16coil / 16);
+		u16currentRegister = u16coil / 16;
 		u8currentBit = (uint8_t)(u16coil % 16);
 
 		bTemp = bitRead(
-			au8Buffer[u8frameByte],
+			au8Buffer[u16frameByte],
 			u8bitsno);
 
 		bitWrite(
-			regs[u8currentRegister],
+			regs[u16currentRegister],
 			u8currentBit,
 			bTemp);
 
@@ -1010,16 +1149,16 @@ int8_t Modbus::process_FC15(int16_t *regs, uint8_t /*u8size*/)
 		if (u8bitsno > 7)
 		{
 			u8bitsno = 0;
-			u8frameByte++;
+			u16frameByte++;
 		}
 	}
 
 	// send outcoming message
 	// it's just a copy of the incomping frame until 6th byte
-	u8BufferSize = 6;
-	u8CopyBufferSize = u8BufferSize + 2;
+	u16BufferSize = 6;
+	u16CopyBufferSize = u16BufferSize + 2;
 	sendTxBuffer();
-	return u8CopyBufferSize;
+	return u16CopyBufferSize;
 }
 
 /**
@@ -1027,33 +1166,33 @@ int8_t Modbus::process_FC15(int16_t *regs, uint8_t /*u8size*/)
  * This method processes function 16
  * This method writes a makeWord array assigned by the master
  *
- * @return u8BufferSize Response to master length
+ * @return u16BufferSize Response to master length
  * @ingroup register
  */
-int8_t Modbus::process_FC16(int16_t *regs, uint8_t /*u8size*/)
+int16_t Modbus::process_FC16(int16_t *regs, uint8_t /*u8size*/)
 {
-	uint8_t u8StartAdd = au8Buffer[ADD_HI] << 8 | au8Buffer[ADD_LO];
-	uint8_t u8regsno = au8Buffer[NB_HI] << 8 | au8Buffer[NB_LO];
-	uint8_t u8CopyBufferSize;
-	uint8_t i;
+	uint16_t u16StartAdd = au8Buffer[ADD_HI] << 8 | au8Buffer[ADD_LO];
+	uint16_t u16regsno = au8Buffer[NB_HI] << 8 | au8Buffer[NB_LO];
+	uint16_t u16CopyBufferSize;
+	uint16_t i;
 	uint16_t temp;
 
 	// build header
-	au8Buffer[NB_HI] = 0;
-	au8Buffer[NB_LO] = u8regsno;
-	u8BufferSize = RESPONSE_SIZE;
+	au8Buffer[NB_HI] = highByte(u16regsno);
+	au8Buffer[NB_LO] = lowByte(u16regsno);
+	u16BufferSize = RESPONSE_SIZE;
 
 	// write registers
-	for (i = 0; i < u8regsno; i++)
+	for (i = 0; i < u16regsno; i++)
 	{
 		temp = makeWord(
 			au8Buffer[(BYTE_CNT + 1) + i * 2],
 			au8Buffer[(BYTE_CNT + 2) + i * 2]);
 
-		regs[u8StartAdd + i] = temp;
+		regs[u16StartAdd + i] = temp;
 	}
-	u8CopyBufferSize = u8BufferSize + 2;
+	u16CopyBufferSize = u16BufferSize + 2;
 	sendTxBuffer();
 
-	return u8CopyBufferSize;
+	return u16CopyBufferSize;
 }
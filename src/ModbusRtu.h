@@ -144,7 +144,20 @@ const unsigned char fctsupported[] =
 		MB_FC_WRITE_MULTIPLE_REGISTERS};
 
 #define T35 5
-#define MAX_BUFFER 64 //!< maximum size for the communication buffer in bytes
+// Maximum size for the communication buffer in bytes, 256 for the full Modbus RTU ADU (125 registers per read).
+// !!! MAX_BUFFER must be a global build flag (e.g. build_flags = -DMAX_BUFFER=256 in platformio.ini) !!!
+// A #define in the sketch changes the size of the Modbus object only for the sketch, not for the library.
+// RAK13015 detects the mismatch and refuses to initialize.
+#ifndef MAX_BUFFER
+#define MAX_BUFFER 64
+#endif
+#if (MAX_BUFFER < 8) || (MAX_BUFFER > 256)
+#error "MAX_BUFFER must be 8 ... 256"
+#endif
+
+#ifndef MODBUS_CRC_FULL_TABLE
+#define MODBUS_CRC_FULL_TABLE 1 //!< CRC lookup table: 1 = 512 byte table, 0 = 32 byte nibble table for small flash
+#endif
 
 /**
  * @class Modbus
@@ -161,27 +174,30 @@ private:
 	uint8_t u8state;
 	uint8_t u8lastError;
 	uint8_t au8Buffer[MAX_BUFFER];
-	uint8_t u8BufferSize;
-	uint8_t u8lastRec;
+	uint16_t u16BufferSize;
+	uint16_t u16RxCRC; //!< CRC of the received bytes, 0 for a frame with a valid CRC
+	uint16_t u16lastRec;
 	int16_t *au16regs;
 	uint16_t u16InCnt, u16OutCnt, u16errCnt;
 	uint16_t u16timeOut;
 	uint32_t u32time, u32timeOut, u32overTime;
 	uint8_t u8regsize;
+	uint8_t u8queryId;		  //!< slave of the pending query
+	uint8_t u8queryFct;		  //!< function code of the pending query
+	uint16_t u16queryCoilsNo; //!< number of coils/registers of the pending query
 
 	void sendTxBuffer();
-	int8_t getRxBuffer();
-	uint16_t calcCRC(uint8_t u8length);
+	int16_t getRxBuffer();
 	uint8_t validateAnswer();
 	uint8_t validateRequest();
 	void get_FC1();
 	void get_FC3();
-	int8_t process_FC1(int16_t *regs, uint8_t u8size);
-	int8_t process_FC3(int16_t *regs, uint8_t u8size);
-	int8_t process_FC5(int16_t *regs, uint8_t u8size);
-	int8_t process_FC6(int16_t *regs, uint8_t u8size);
-	int8_t process_FC15(int16_t *regs, uint8_t u8size);
-	int8_t process_FC16(int16_t *regs, uint8_t u8size);
+	int16_t process_FC1(int16_t *regs, uint8_t u8size);
+	int16_t process_FC3(int16_t *regs, uint8_t u8size);
+	int16_t process_FC5(int16_t *regs, uint8_t u8size);
+	int16_t process_FC6(int16_t *regs, uint8_t u8size);
+	int16_t process_FC15(int16_t *regs, uint8_t u8size);
+	int16_t process_FC16(int16_t *regs, uint8_t u8size);
 	void buildException(uint8_t u8exception); // build exception message
 
 public:
@@ -193,8 +209,8 @@ public:
 	uint16_t getTimeOut();						//!< get communication watch-dog timer value
 	boolean getTimeOutState();					//!< get communication watch-dog timer state
 	int8_t query(modbus_t telegram);			//!< only for master
-	int8_t poll();								//!< cyclic poll for master
-	int8_t poll(int16_t *regs, uint8_t u8size); //!< cyclic poll for slave
+	int16_t poll();								 //!< cyclic poll for master
+	int16_t poll(int16_t *regs, uint8_t u8size); //!< cyclic poll for slave
 	uint16_t getInCnt();						//!< number of incoming messages
 	uint16_t getOutCnt();						//!< number of outcoming messages
 	uint16_t getErrCnt();						//!< error counter
@@ -205,6 +221,9 @@ public:
 	void setTxendPinOverTime(uint32_t u32overTime);
 	void end(); //!< finish any communication and release serial communication port
 
+	static uint16_t updateCRC(uint16_t u16crc, uint8_t u8data);								//!< add one byte to a CRC-16/Modbus
+	static uint16_t calcCRC(const uint8_t *au8data, uint16_t u16length, uint16_t u16crc = 0xFFFF); //!< CRC-16/Modbus of a buffer
+
 };
 
 #endif // MODBUS_RTU_H
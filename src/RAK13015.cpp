@@ -10,15 +10,185 @@
  */
 #include "RAK13015.h"
 
-/** First ADC on the RAK13015 */
-RAK_ADC_SGM58031 _ad0(ad0_addr);
-/** Second ADC on the RAK13015 */
-RAK_ADC_SGM58031 _ad1(ad1_addr);
-/** Simple Modbus RTU */
-Modbus master(0, Serial1, 0);
+static_assert((RAK13015_MAX_MODULES >= 1) && (RAK13015_MAX_MODULES <= 4), "RAK13015_MAX_MODULES must be 1 ... 4");
 
-RAK13015::RAK13015(uint8_t slot, uint8_t base_board) : _used_slot(slot), _used_base(base_board)
+/** Instances handling an ALERT/RDY interrupt */
+RAK13015 *RAK13015::_isr_owner[RAK13015_MAX_MODULES] = {NULL};
+/** Interrupt handler of each owner entry */
+void (*const RAK13015::_isr_entry[RAK13015_MAX_MODULES])(void) = {
+	alertISR<0>,
+#if RAK13015_MAX_MODULES > 1
+	alertISR<1>,
+#endif
+#if RAK13015_MAX_MODULES > 2
+	alertISR<2>,
+#endif
+#if RAK13015_MAX_MODULES > 3
+	alertISR<3>,
+#endif
+};
+
+/** uA per count * 2^32 of the 4-20mA channels (150 Ohm shunt) for each PGA setting */
+static const int64_t micro_4_20_mult[8] = {5368872965LL, 3579248643LL, 1789624322LL, 894812161LL,
+										   447406080LL, 223703040LL, 223703040LL, 223703040LL};
+/** uV per count * 2^32 of the analog channels (1:11 divider) for each PGA setting */
+static const int64_t micro_ana_mult[8] = {8858640392250LL, 5905760261500LL, 2952880130750LL, 1476440065375LL,
+										  738220032688LL, 369110016344LL, 369110016344LL, 369110016344LL};
+
+/**
+ * @brief Fixed point conversion, (raw * mult + 2^31) >> 32.
+ * 		Equals the exact value rounded half up (towards +infinity) for every raw value
+ *
+ * @param raw Raw ADC counts
+ * @param mult Scale factor * 2^32
+ * @return int32_t scaled value
+ */
+static inline int32_t scale_fixed(int16_t raw, int64_t mult)
+{
+	return (int32_t)(((int64_t)raw * mult + (1LL << 31)) >> 32);
+}
+
+/** Calibration blob header and format version */
+#define CAL_MAGIC_0 'R'
+#define CAL_MAGIC_1 'C'
+#define CAL_VERSION 1
+
+/**
+ * @brief Fletcher-16 checksum
+ *
+ * @param data Data
+ * @param size Number of bytes
+ * @return uint16_t checksum, sum2 in the high byte, sum1 in the low byte
+ */
+static uint16_t fletcher16(const uint8_t *data, uint16_t size)
+{
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	for (uint16_t idx = 0; idx < size; idx++)
+	{
+		sum1 = (sum1 + data[idx]) % 255;
+		sum2 = (sum2 + sum1) % 255;
+	}
+	return (sum2 << 8) | sum1;
+}
+
+/** Little endian 32 bit store */
+static void put_int32(uint8_t *data, int32_t value)
+{
+	for (uint8_t idx = 0; idx < 4; idx++)
+	{
+		data[idx] = (uint8_t)((uint32_t)value >> (8 * idx));
+	}
+}
+
+/** Little endian 32 bit load */
+static int32_t get_int32(const uint8_t *data)
+{
+	return (int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+}
+
+/** Saturate a 64 bit value to the 32 bit range */
+static int64_t clamp_int32(int64_t value)
+{
+	if (value > INT32_MAX)
+	{
+		return INT32_MAX;
+	}
+	if (value < INT32_MIN)
+	{
+		return INT32_MIN;
+	}
+	return value;
+}
+
+/**
+ * @brief Check a calibration table and compute the slopes of its segments
+ *
+ * @param measured Table input, must be strictly ascending
+ * @param actual Table output
+ * @param points Number of table points
+ * @param slope Receives the slope * 2^24 of the points - 1 segments, NULL to only check the table
+ * @return true if the table is valid, false if it is not ascending or a slope does not fit -128 ... 128
+ */
+static bool cal_slopes(const int32_t *measured, const int32_t *actual, uint8_t points, int32_t *slope)
+{
+	for (uint8_t idx = 1; idx < points; idx++)
+	{
+		int64_t rise = (int64_t)actual[idx] - actual[idx - 1];
+		int64_t run = (int64_t)measured[idx] - measured[idx - 1];
+		if (run <= 0)
+		{
+			return false;
+		}
+		// Rounded to nearest, run is always positive
+		int64_t q24 = (rise * 16777216 + (rise >= 0 ? run / 2 : -run / 2)) / run;
+		if ((q24 > INT32_MAX) || (q24 < INT32_MIN))
+		{
+			return false;
+		}
+		if (slope != NULL)
+		{
+			slope[idx - 1] = (int32_t)q24;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Disable interrupts and keep the previous state, unlike noInterrupts() / interrupts()
+ * 		the pair can be used inside an interrupt handler, e.g. with RAK13015_I2C_IN_ISR
+ *
+ * @return uint32_t interrupt state to restore with unlock_interrupts()
+ */
+static inline uint32_t lock_interrupts(void)
+{
+#if defined(ARDUINO_ARCH_ESP32)
+	return portSET_INTERRUPT_MASK_FROM_ISR();
+#elif defined(__arm__)
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+#elif defined(__AVR__)
+	uint8_t sreg = SREG;
+	cli();
+	return sreg;
+#else
+	// State not readable on this architecture, interrupts are enabled again on unlock
+	noInterrupts();
+	return 0;
+#endif
+}
+
+/** Restore the interrupt state saved by lock_interrupts() */
+static inline void unlock_interrupts(uint32_t state)
+{
+#if defined(ARDUINO_ARCH_ESP32)
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+#elif defined(__arm__)
+	__set_PRIMASK(state);
+#elif defined(__AVR__)
+	SREG = (uint8_t)state;
+#else
+	(void)state;
+	interrupts();
+#endif
+}
+
+/** Multiplexer sequence of the first ADC for readAll() */
+static const uint8_t ad0_sequence[] = {RAK13015_CH_4_20_0, RAK13015_CH_4_20_1, RAK13015_CH_4_20_2, RAK13015_CH_ANA_0};
+
+RAK13015::RAK13015(uint8_t slot, uint8_t base_board, TwoWire &wire, size_t layout)
+	: _rs485(slotSerial(slot, base_board)), _used_slot(slot), _used_base(base_board),
+	  _ad0(&wire, ad0_addr), _ad1(&wire, ad1_addr), _master(0, _rs485, 0)
 {
+	// The Modbus master is part of the object, a MAX_BUFFER defined only in the sketch changes its size
+	_layout_ok = (layout == sizeof(RAK13015));
+	for (uint8_t channel = 0; channel < RAK13015_NUM_CH; channel++)
+	{
+		_range_used[channel] = _channel_config[channel] & SGM58031_CONFIG_PGA;
+		_range_peak[channel] = 0.0;
+		_raw_used[channel] = 0;
+	}
 	switch (_used_slot)
 	{
 	case SLOT_A: // Not possible, WB_IO2 conflict
@@ -32,7 +202,6 @@ RAK13015::RAK13015(uint8_t slot, uint8_t base_board) : _used_slot(slot), _used_b
 	case SLOT_C: // Only possible on RAK19003
 		// Serial1.begin(9600);
 		_used_serial = 1;
-		_rs485 = Serial1;
 		if (_used_base == RAK19003)
 		{
 			_alert_pin = ALERT_C;
@@ -49,7 +218,6 @@ RAK13015::RAK13015(uint8_t slot, uint8_t base_board) : _used_slot(slot), _used_b
 		{
 			// Serial2.begin(9600);
 			_used_serial = 2;
-			_rs485 = Serial2;
 			_alert_pin = ALERT_D;
 			_tcon_pin = TCON_D;
 		}
@@ -57,7 +225,6 @@ RAK13015::RAK13015(uint8_t slot, uint8_t base_board) : _used_slot(slot), _used_b
 		{
 			// Serial1.begin(9600);
 			_used_serial = 1;
-			_rs485 = Serial1;
 			_alert_pin = ALERT_D;
 			_tcon_pin = TCON_D;
 		}
@@ -67,7 +234,6 @@ RAK13015::RAK13015(uint8_t slot, uint8_t base_board) : _used_slot(slot), _used_b
 	case SLOT_E: // Only possible on RAK19001
 		// Serial2.begin(9600);
 		_used_serial = 2;
-		_rs485 = Serial2;
 		if (_used_base == RAK19001)
 		{
 			_alert_pin = ALERT_E;
@@ -82,7 +248,6 @@ RAK13015::RAK13015(uint8_t slot, uint8_t base_board) : _used_slot(slot), _used_b
 	case SLOT_F: // Only possible on RAK19001
 		// Serial1.begin(9600);
 		_used_serial = 1;
-		_rs485 = Serial1;
 		if (_used_base == RAK19001)
 		{
 			_alert_pin = ALERT_E;
@@ -101,13 +266,42 @@ RAK13015::RAK13015(uint8_t slot, uint8_t base_board) : _used_slot(slot), _used_b
 	}
 }
 
-bool RAK13015::initRAK13015(float analog_resolution, uint16_t baud)
+RAK13015::~RAK13015()
+{
+	releaseAlert();
+}
+
+Stream &RAK13015::slotSerial(uint8_t slot, uint8_t base_board)
+{
+	// Slot D uses Serial2 only on RAK19001, Slot E is only possible on RAK19001
+	if (((slot == SLOT_D) && (base_board == RAK19001)) || (slot == SLOT_E))
+	{
+		return Serial2;
+	}
+	return Serial1;
+}
+
+bool RAK13015::checkSetup(void)
 {
+	if (!_layout_ok)
+	{
+		RAK13015_LOG("RAK13015", "Sketch and library use a different MAX_BUFFER, set it as global build flag");
+		return false;
+	}
 	if ((_alert_pin == -1) || (_tcon_pin == -1))
 	{
 		RAK13015_LOG("RAK13015", "Invalid slot / base board selection");
 		return false;
 	}
+	return true;
+}
+
+bool RAK13015::initRAK13015(float analog_resolution, uint16_t baud)
+{
+	if (!checkSetup())
+	{
+		return false;
+	}
 
 	bool result_analog, result_modbus = true;
 
@@ -130,53 +324,68 @@ bool RAK13015::initRAK13015(float analog_resolution, uint16_t baud)
 	return false;
 }
 
-bool RAK13015::initAnalog_4_20(float resolution)
+bool RAK13015::initAnalog_4_20(float resolution, bool warm)
 {
-	if ((_alert_pin == -1) || (_tcon_pin == -1))
+	if (!checkSetup())
 	{
-		RAK13015_LOG("RAK13015", "Invalid slot / base board selection");
 		return false;
 	}
 
-	// Check for I2C devices
-	byte error;
-	bool found_ch0 = false;
-	bool found_ch1 = false;
-
-	Wire.begin();
+	uint32_t start = micros();
+	// Both ADCs are on the I2C bus of this module
+	_ad0.begin();
 
-	for (byte address = 1; address < 127; address++)
+	if (warm && _verified)
+	{
+		// Module stayed powered, ADCs and register shadows are still valid
+		_init_stats.warm++;
+	}
+	else
 	{
-		Wire.beginTransmission(address);
-		error = Wire.endTransmission();
-		if (error == 0)
+		// Registers are back to reset values after a power cycle of the module
+		_ad0.resetShadow();
+		_ad1.resetShadow();
+		// Probe only the two ADC addresses, a missing device reads as chip ID 0
+		_init_stats.chip_id[0] = _ad0.getChipID();
+		_init_stats.chip_id[1] = _ad1.getChipID();
+		_init_stats.cold++;
+		_verified = ((_init_stats.chip_id[0] & 0x00E0) == DEVICE_ID) && ((_init_stats.chip_id[1] & 0x00E0) == DEVICE_ID);
+		RAK13015_LOG("INIT", "Chip ID 0x%02X: %04X 0x%02X: %04X", ad0_addr, _init_stats.chip_id[0], ad1_addr, _init_stats.chip_id[1]);
+		if (!_verified)
 		{
-			RAK13015_LOG("SCAN", "Found sensor at I2C1 0x%02X", address);
-			if (address == ad0_addr)
-			{
-				found_ch0 = true;
-			}
-			if (address == ad1_addr)
-			{
-				found_ch1 = true;
-			}
+			_init_stats.failed++;
+			_init_stats.last_us = micros() - start;
+			return false;
 		}
 	}
 
-	if (found_ch0 && found_ch1)
+	_ad0.setVoltageResolution(resolution);
+	_ad1.setVoltageResolution(resolution);
+	// The resolution selects the PGA of all channels
+	uint16_t pga = RAK_ADC_SGM58031::getPgaBits(resolution);
+	for (uint8_t channel = 0; channel < RAK13015_NUM_CH; channel++)
 	{
-		_ad0.setVoltageResolution(resolution);
-		_ad1.setVoltageResolution(resolution);
-		return true;
+		changeRange(channel, pga);
+		_range_used[channel] = pga;
 	}
-	return false;
+
+	_init_stats.last_us = micros() - start;
+	if (_init_stats.last_us > _init_stats.max_us)
+	{
+		_init_stats.max_us = _init_stats.last_us;
+	}
+	return true;
+}
+
+void RAK13015::getInitStats(rak13015_init_stats_t &stats)
+{
+	stats = _init_stats;
 }
 
 bool RAK13015::initModbus(uint16_t baud)
 {
-	if ((_alert_pin == -1) || (_tcon_pin == -1))
+	if (!checkSetup())
 	{
-		RAK13015_LOG("RAK13015", "Invalid slot / base board selection");
 		return false;
 	}
 
@@ -195,131 +404,1350 @@ bool RAK13015::initModbus(uint16_t baud)
 		return false;
 		break;
 	}
-	master.setUART(_rs485);
-	master.start();
-	master.setTimeOut(2000); // if there is no answer in 2000 ms, roll over
+	_master.setUART(_rs485);
+	_master.start();
+	_master.setTimeOut(2000); // if there is no answer in 2000 ms, roll over
 
 	return true;
 }
 
 float RAK13015::readAnalog(uint16_t port)
 {
-	float measured = -50.0;
 	switch (port)
 	{
 	case ANA_CH_0:
-		_ad0.setConfig(ANA_CH_0);
-		delay(100); // Estimated conversion time
-		_voltage_ch0 = _ad0.getVoltage();
-		_voltage_ch0 = _voltage_ch0 * 11;
-		RAK13015_LOG("V", "CH0 = %.2fV", _voltage_ch0);
-		measured = _voltage_ch0;
-		break;
+		return readChannel(RAK13015_CH_ANA_0);
 	case ANA_CH_1:
-		_ad1.setConfig(ANA_CH_1);
-		delay(100); // Estimated conversion time
-		_voltage_ch1 = _ad1.getVoltage();
-		_voltage_ch1 = _voltage_ch1 * 11;
-		RAK13015_LOG("V", "CH0 = %.2fV", _voltage_ch1);
-		measured = _voltage_ch1;
-		break;
+		return readChannel(RAK13015_CH_ANA_1);
 	}
-	return measured;
+	return -50.0;
 }
 
 float RAK13015::read4_20ma(uint16_t port)
 {
-	float measured = -50.0;
 	switch (port)
 	{
 	case I_4_20_CH_0:
-		_ad0.setConfig(I_4_20_CH_0);
-		delay(100); // Estimated conversion time
-		_current_ch0 = _ad0.getVoltage();
-		_current_ch0 = _current_ch0 / 150 * 1000;
-		RAK13015_LOG("4-20", "CH0 = %.2fmA", _current_ch0);
-		measured = _current_ch0;
-		break;
+		return readChannel(RAK13015_CH_4_20_0);
 	case I_4_20_CH_1:
-		_ad0.setConfig(I_4_20_CH_1);
-		delay(100); // Estimated conversion time
-		_current_ch1 = _ad0.getVoltage();
-		_current_ch1 = _current_ch1 / 150 * 1000;
-		RAK13015_LOG("4-20", "CH1 = %.2fmA", _current_ch1);
-		measured = _current_ch1;
-		break;
+		return readChannel(RAK13015_CH_4_20_1);
 	case I_4_20_CH_2:
-		_ad0.setConfig(I_4_20_CH_2);
-		delay(100); // Estimated conversion time
-		_current_ch2 = _ad0.getVoltage();
-		_current_ch2 = _current_ch2 / 150 * 1000;
-		RAK13015_LOG("4-20", "CH1 = %.2fmA", _current_ch2);
-		measured = _current_ch2;
-		break;
+		return readChannel(RAK13015_CH_4_20_2);
 	}
-	return measured;
+	return -50.0;
 }
 
-bool RAK13015::requestModBus(uint8_t slave_addr, uint16_t address, uint16_t num_coils, uint16_t *coils_regs, time_t timeout)
+bool RAK13015::scanAll(float *values)
+{
+	rak13015_snapshot_t snapshot;
+	bool result = readAll(snapshot);
+	memcpy(values, snapshot.values, sizeof(snapshot.values));
+	return result;
+}
+
+bool RAK13015::readAll(rak13015_snapshot_t &snapshot)
 {
-	modbus_t telegram;
-	telegram.u8id = slave_addr;				  // slave address
-	telegram.u8fct = MB_FC_READ_REGISTERS;	  // function code (this one is registers read)
-	telegram.u16RegAdd = address;			  // start address in slave
-	telegram.u16CoilsNo = num_coils;		  // number of elements (coils or registers) to read
-	telegram.au16reg = (int16_t *)coils_regs; // pointer to a memory array
+	if (!beginScan(snapshot))
+	{
+		return false;
+	}
+	for (uint8_t step = 0; step < sizeof(ad0_sequence); step++)
+	{
+		stepScan(snapshot, step);
+	}
+	return endScan(snapshot);
+}
 
-	master.setTimeOut(timeout + 1000);
+uint8_t RAK13015::readModules(RAK13015 *modules[], uint8_t count, rak13015_snapshot_t snapshots[])
+{
+	// The conversions of all modules run in parallel, waiting for one module's result gives the others time to finish
+	for (uint8_t idx = 0; idx < count; idx++)
+	{
+		modules[idx]->beginScan(snapshots[idx]);
+	}
+	for (uint8_t step = 0; step < sizeof(ad0_sequence); step++)
+	{
+		for (uint8_t idx = 0; idx < count; idx++)
+		{
+			if (modules[idx]->_scanning)
+			{
+				modules[idx]->stepScan(snapshots[idx], step);
+			}
+		}
+	}
+	uint8_t complete = 0;
+	for (uint8_t idx = 0; idx < count; idx++)
+	{
+		if (modules[idx]->_scanning && modules[idx]->endScan(snapshots[idx]))
+		{
+			complete++;
+		}
+	}
+	return complete;
+}
 
-	if (master.query(telegram) != 0) // send query (only once)
+bool RAK13015::beginScan(rak13015_snapshot_t &snapshot)
+{
+	_scanning = false;
+	snapshot.valid = 0;
+	for (uint8_t channel = 0; channel < RAK13015_NUM_CH; channel++)
+	{
+		snapshot.values[channel] = -50.0;
+		snapshot.raw[channel] = 0;
+		snapshot.range[channel] = 0.0;
+		snapshot.micro[channel] = 0;
+	}
+	if ((_adc_read[0].state == READ_CONVERTING) || (_adc_read[1].state == READ_CONVERTING) ||
+		isAcquiring(RAK13015_CH_4_20_0) || isAcquiring(RAK13015_CH_ANA_1))
 	{
-		RAK13015_LOG("Mod", "Query read failed");
+		RAK13015_LOG("ADC", "ADC busy with non-blocking read, acquisition or window monitoring");
 		return false;
 	}
 
-	time_t start_poll = millis();
+	// The second ADC has only ANA_CH_1, it converts in parallel to the sequence of the first ADC
+	selectChannel(RAK13015_CH_ANA_1).startConversion(_channel_config[RAK13015_CH_ANA_1]);
+	selectChannel(ad0_sequence[0]).startConversion(_channel_config[ad0_sequence[0]]);
+	_scan_remeasure = 0;
+	_scanning = true;
+	return true;
+}
+
+void RAK13015::stepScan(rak13015_snapshot_t &snapshot, uint8_t step)
+{
+	bool ready = _ad0.waitConversionReady();
+	// Program the next channel right away, the conversion register keeps the result until the next conversion ends
+	if (step < (sizeof(ad0_sequence) - 1))
+	{
+		selectChannel(ad0_sequence[step + 1]).startConversion(_channel_config[ad0_sequence[step + 1]]);
+	}
+	if (storeResult(snapshot, ad0_sequence[step], ready))
+	{
+		_scan_remeasure |= 1 << ad0_sequence[step];
+	}
+}
+
+bool RAK13015::endScan(rak13015_snapshot_t &snapshot)
+{
+	_scanning = false;
+	uint8_t remeasure = _scan_remeasure;
+	if (storeResult(snapshot, RAK13015_CH_ANA_1, _ad1.waitConversionReady()))
+	{
+		remeasure |= 1 << RAK13015_CH_ANA_1;
+	}
 
-	while ((millis() - start_poll) < timeout)
+	// Saturated readings of auto-ranging channels, measured again in the next larger range until they fit
+	for (uint8_t channel = 0; channel < RAK13015_NUM_CH; channel++)
 	{
-		master.poll(); // check incoming messages
-		if (master.getState() == COM_IDLE)
+		while (remeasure & (1 << channel))
 		{
-			RAK13015_LOG("Mod", "State COM_IDLE");
-			return true;
+			RAK_ADC_SGM58031 &adc = selectChannel(channel);
+			adc.startConversion(_channel_config[channel]);
+			if (!storeResult(snapshot, channel, adc.waitConversionReady()))
+			{
+				remeasure &= ~(1 << channel);
+			}
 		}
 	}
-	RAK13015_LOG("Mod", "Poll read timeout");
+
+	return snapshot.valid == ((1 << RAK13015_NUM_CH) - 1);
+}
+
+bool RAK13015::storeResult(rak13015_snapshot_t &snapshot, uint8_t channel, bool ready)
+{
+	if (!ready)
+	{
+		RAK13015_LOG("ADC", "CH%d conversion timeout", channel);
+		return false;
+	}
+	int16_t raw = (int16_t)adcOf(channel).getAdcValue();
+	if (!convertSample(channel, raw, snapshot.values[channel]))
+	{
+		return true;
+	}
+	snapshot.raw[channel] = raw;
+	snapshot.range[channel] = RAK_ADC_SGM58031::getFullScale(_range_used[channel]);
+	snapshot.micro[channel] = getMicro(channel);
+	snapshot.valid |= 1 << channel;
+	_values[channel] = snapshot.values[channel];
 	return false;
 }
 
-bool RAK13015::writeModBus(uint8_t slave_addr, uint16_t address, uint16_t num_coils, uint16_t *coils_regs, time_t timeout)
+bool RAK13015::startRead(uint8_t channel)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return false;
+	}
+	adc_read_t &read = _adc_read[adcIndex(channel)];
+	if ((read.state == READ_CONVERTING) || isAcquiring(channel))
+	{
+		RAK13015_LOG("ADC", "ADC busy");
+		return false;
+	}
+	selectChannel(channel).startConversion(_channel_config[channel]);
+	read.channel = channel;
+	read.start = micros();
+	read.state = READ_CONVERTING;
+	return true;
+}
+
+bool RAK13015::isReady(uint8_t channel)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return false;
+	}
+	adc_read_t &read = _adc_read[adcIndex(channel)];
+	if (read.channel != channel)
+	{
+		return false;
+	}
+	if (read.state == READ_CONVERTING)
+	{
+		RAK_ADC_SGM58031 &adc = adcOf(channel);
+		if (adc.isConversionReady())
+		{
+			int16_t raw = (int16_t)adc.getAdcValue();
+			if (convertSample(channel, raw, read.value))
+			{
+				read.state = READ_READY;
+			}
+			else
+			{
+				// Saturated, measure again in the larger range
+				selectChannel(channel).startConversion(_channel_config[channel]);
+				read.start = micros();
+			}
+		}
+		else if ((micros() - read.start) > adcOf(channel).getConversionTime(_channel_config[channel]))
+		{
+			RAK13015_LOG("ADC", "CH%d conversion timeout", channel);
+			read.state = READ_TIMEOUT;
+		}
+	}
+	return (read.state == READ_READY) || (read.state == READ_TIMEOUT);
+}
+
+float RAK13015::fetch(uint8_t channel)
+{
+	if (!isReady(channel))
+	{
+		return -50.0;
+	}
+	adc_read_t &read = _adc_read[adcIndex(channel)];
+	float measured = -50.0;
+	if (read.state == READ_READY)
+	{
+		measured = read.value;
+		_values[channel] = measured;
+		RAK13015_LOG("ADC", "CH%d = %.2f", channel, measured);
+	}
+	read.state = READ_IDLE;
+	return measured;
+}
+
+bool RAK13015::waitRead(uint8_t channel)
+{
+	while (!isReady(channel))
+	{
+		if (_adc_read[adcIndex(channel)].channel != channel)
+		{
+			return false;
+		}
+	}
+	return _adc_read[adcIndex(channel)].state == READ_READY;
+}
+
+float RAK13015::readChannel(uint8_t channel)
+{
+	float measured;
+	// An empty filter window is filled with back-to-back conversions, the first result is already filtered
+	do
+	{
+		if (!startRead(channel))
+		{
+			return -50.0;
+		}
+		waitRead(channel);
+		measured = fetch(channel);
+	} while ((measured != -50.0) && !_filter[channel].isPrimed());
+	return measured;
+}
+
+int16_t RAK13015::readRaw(uint8_t channel)
 {
-	modbus_t telegram;
-	telegram.u8id = slave_addr;					 // slave address
-	telegram.u8fct = MB_FC_WRITE_MULTIPLE_COILS; // function code (this one is registers write)
-	telegram.u16RegAdd = address;				 // start address in slave
-	telegram.u16CoilsNo = num_coils;			 // number of elements (coils or registers) to read
-	telegram.au16reg = (int16_t *)coils_regs;	 // pointer to a memory array
+	int16_t raw = _filter[channel].update((int16_t)adcOf(channel).getAdcValue());
+	accumulate(channel, toValue(channel, raw));
+	return raw;
+}
 
-	master.setTimeOut(timeout + 1000);
+void RAK13015::accumulate(uint8_t channel, float value)
+{
+	// Welford update, interrupts are disabled so a snapshot never sees a half updated state.
+	// Called from the ALERT interrupt with RAK13015_I2C_IN_ISR, the interrupt state is restored, not enabled
+	uint32_t state = lock_interrupts();
+	stats_t &stats = _stats[channel];
+	stats.count++;
+	if (stats.count == 1)
+	{
+		stats.min = value;
+		stats.max = value;
+		stats.mean = value;
+		stats.m2 = 0.0;
+	}
+	else
+	{
+		stats.min = value < stats.min ? value : stats.min;
+		stats.max = value > stats.max ? value : stats.max;
+		float delta = value - stats.mean;
+		stats.mean += delta / stats.count;
+		stats.m2 += delta * (value - stats.mean);
+	}
+	unlock_interrupts(state);
+}
 
-	if (master.query(telegram) != 0) // send query (only once)
+bool RAK13015::getStatistics(uint8_t channel, rak13015_stats_t &stats, bool reset)
+{
+	if (channel >= RAK13015_NUM_CH)
 	{
-		RAK13015_LOG("Mod", "Query write failed");
 		return false;
 	}
+	uint32_t state = lock_interrupts();
+	stats_t snapshot = _stats[channel];
+	if (reset)
+	{
+		_stats[channel].count = 0;
+	}
+	unlock_interrupts(state);
 
-	time_t start_poll = millis();
+	stats.count = snapshot.count;
+	if (snapshot.count == 0)
+	{
+		stats.min = stats.max = stats.mean = stats.variance = stats.stddev = 0.0;
+		return false;
+	}
+	stats.min = snapshot.min;
+	stats.max = snapshot.max;
+	stats.mean = snapshot.mean;
+	stats.variance = snapshot.count > 1 ? snapshot.m2 / (snapshot.count - 1) : 0.0;
+	stats.stddev = sqrtf(stats.variance);
+	return true;
+}
 
-	while ((millis() - start_poll) < timeout)
+void RAK13015::resetStatistics(uint8_t channel)
+{
+	uint32_t state = lock_interrupts();
+	for (uint8_t idx = 0; idx < RAK13015_NUM_CH; idx++)
 	{
-		master.poll(); // check incoming messages
-		if (master.getState() == COM_IDLE)
+		if ((channel == idx) || (channel == RAK13015_NUM_CH))
 		{
-			RAK13015_LOG("Mod", "State COM_IDLE");
-			return true;
+			_stats[idx].count = 0;
 		}
 	}
-	RAK13015_LOG("Mod", "Poll write timeout");
-	return false;
+	unlock_interrupts(state);
+}
+
+float RAK13015::toVoltage(uint8_t channel, int16_t raw)
+{
+	return raw * RAK_ADC_SGM58031::getFullScale(_channel_config[channel]) / 32767.0;
+}
+
+bool RAK13015::convertSample(uint8_t channel, int16_t &raw, float &value)
+{
+	uint16_t pga = _channel_config[channel] & SGM58031_CONFIG_PGA;
+	bool auto_range = (_auto_range & (1 << channel)) != 0;
+	int32_t magnitude = raw < 0 ? -(int32_t)raw : raw;
+	if (auto_range && (magnitude >= RAK13015_RANGE_SATURATION) && (pga > SGM58031_PGA_6_144))
+	{
+		RAK13015_LOG("ADC", "CH%d saturated, range %.3f V", channel, RAK_ADC_SGM58031::getFullScale(pga - SGM58031_PGA_STEP));
+		changeRange(channel, pga - SGM58031_PGA_STEP);
+		_range_peak[channel] = 0.0;
+		return false;
+	}
+
+	raw = _filter[channel].update(raw);
+	value = toValue(channel, raw);
+	accumulate(channel, value);
+	_range_used[channel] = pga;
+	_raw_used[channel] = raw;
+	if (!auto_range)
+	{
+		return true;
+	}
+
+	// Envelope of the magnitude, fast attack, slow decay
+	float voltage = magnitude * RAK_ADC_SGM58031::getFullScale(pga) / 32767.0;
+	if (voltage > _range_peak[channel])
+	{
+		_range_peak[channel] = voltage;
+	}
+	else
+	{
+		_range_peak[channel] += (voltage - _range_peak[channel]) / 8;
+	}
+
+	// Smallest range with headroom for the next reading
+	uint16_t next = pga;
+	while ((next < SGM58031_PGA_0_256) &&
+		   (_range_peak[channel] < (RAK_ADC_SGM58031::getFullScale(next + SGM58031_PGA_STEP) * RAK13015_RANGE_HEADROOM / 100)))
+	{
+		next += SGM58031_PGA_STEP;
+	}
+	if (next != pga)
+	{
+		changeRange(channel, next);
+	}
+	return true;
+}
+
+void RAK13015::changeRange(uint8_t channel, uint16_t pga)
+{
+	uint16_t old_pga = _channel_config[channel] & SGM58031_CONFIG_PGA;
+	if (old_pga == pga)
+	{
+		return;
+	}
+	// Keep the filter history, scaled to the counts of the new range
+	_filter[channel].rescale((int32_t)(RAK_ADC_SGM58031::getFullScale(old_pga) * 1000), (int32_t)(RAK_ADC_SGM58031::getFullScale(pga) * 1000));
+	_channel_config[channel] = (_channel_config[channel] & ~SGM58031_CONFIG_PGA) | pga;
+}
+
+int16_t RAK13015::toRaw(uint8_t channel, float value)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return 0;
+	}
+	float voltage;
+	if (channel <= RAK13015_CH_4_20_2)
+	{
+		// 150 Ohm shunt, value in mA
+		voltage = value * 150 / 1000;
+	}
+	else
+	{
+		// 1:11 voltage divider, value in V
+		voltage = value / 11;
+	}
+	float raw = voltage * 32767.0 / RAK_ADC_SGM58031::getFullScale(_channel_config[channel]);
+	if (raw >= 32767.0)
+	{
+		return 32767;
+	}
+	if (raw <= -32768.0)
+	{
+		return -32768;
+	}
+	return (int16_t)(raw >= 0 ? raw + 0.5 : raw - 0.5);
+}
+
+RAK_ADC_SGM58031 &RAK13015::adcOf(uint8_t channel)
+{
+	return adcIndex(channel) ? _ad1 : _ad0;
+}
+
+RAK_ADC_SGM58031 &RAK13015::selectChannel(uint8_t channel)
+{
+	RAK_ADC_SGM58031 &adc = adcOf(channel);
+	// Config1 is shadowed, the I2C write is only done if the table changes
+	adc.setDataRateSelect((_channel_dr_sel & (1 << channel)) != 0);
+	return adc;
+}
+
+float RAK13015::toEngineering(uint8_t channel, float voltage)
+{
+	if (channel <= RAK13015_CH_4_20_2)
+	{
+		// 150 Ohm shunt, result in mA
+		return voltage / 150 * 1000;
+	}
+	// 1:11 voltage divider, result in V
+	return voltage * 11;
+}
+
+bool RAK13015::startAcquisition(uint8_t channel, uint16_t data_rate)
+{
+	if ((channel >= RAK13015_NUM_CH) || (_alert_pin == -1))
+	{
+		RAK13015_LOG("ACQ", "Invalid channel or no ALERT pin on this slot");
+		return false;
+	}
+	if ((_acq_channel != RAK13015_NUM_CH) || (_adc_read[adcIndex(channel)].state == READ_CONVERTING) ||
+		(_window_channel[0] != RAK13015_NUM_CH) || (_window_channel[1] != RAK13015_NUM_CH))
+	{
+		RAK13015_LOG("ACQ", "ADC or ALERT pin busy");
+		return false;
+	}
+	if (!claimAlert())
+	{
+		return false;
+	}
+
+	// Only the ADC of the acquisition may drive the shared ALERT line
+	adcOf(adcIndex(channel) ? RAK13015_CH_4_20_0 : RAK13015_CH_ANA_1).setReadyPin(-1);
+	RAK_ADC_SGM58031 &adc = selectChannel(channel);
+	adc.setReadyPin(_alert_pin);
+
+	_acq_queue.clear();
+	_acq_edges = 0;
+	_acq_handled = 0;
+	_acq_missed = 0;
+	_acq_channel = channel;
+	attachInterrupt(digitalPinToInterrupt(_alert_pin), _isr_entry[_isr_slot], FALLING);
+
+	adc.startContinuous((_channel_config[channel] & ~SGM58031_CONFIG_DR) | (data_rate & SGM58031_CONFIG_DR));
+	return true;
+}
+
+void RAK13015::stopAcquisition(void)
+{
+	if (_acq_channel == RAK13015_NUM_CH)
+	{
+		return;
+	}
+	releaseAlert();
+	adcOf(_acq_channel).stopContinuous();
+	_acq_channel = RAK13015_NUM_CH;
+
+	// Back to the conversion ready detection selected with useAlertReady()
+	useAlertReady(_alert_ready);
+}
+
+uint16_t RAK13015::serviceAcquisition(void)
+{
+#if RAK13015_I2C_IN_ISR > 0
+	// Conversion results are read in the ISR
+	return 0;
+#else
+	if (_acq_channel == RAK13015_NUM_CH)
+	{
+		return 0;
+	}
+	// Edge count and time of the same edge, the ISR must not run between the two reads
+	uint32_t state = lock_interrupts();
+	uint16_t edges = _acq_edges;
+	uint32_t edge_time = _acq_edge_time;
+	unlock_interrupts(state);
+	uint16_t pending = edges - _acq_handled;
+	if (pending == 0)
+	{
+		return 0;
+	}
+	// The conversion register holds only the latest result, older conversions are lost
+	_acq_missed += pending - 1;
+	_acq_handled = edges;
+
+	rak13015_sample_t sample;
+	sample.timestamp = edge_time;
+	sample.raw = readRaw(_acq_channel);
+	sample.channel = _acq_channel;
+	_acq_queue.push(sample);
+	return 1;
+#endif
+}
+
+uint16_t RAK13015::readAcquisition(rak13015_sample_t *samples, uint16_t max_samples)
+{
+	uint16_t count = 0;
+	while ((count < max_samples) && _acq_queue.pop(samples[count]))
+	{
+		count++;
+	}
+	return count;
+}
+
+uint16_t RAK13015::getAcquisitionLost(void)
+{
+	return _acq_missed + _acq_queue.dropped();
+}
+
+uint16_t RAK13015::captureBurst(uint8_t channel, int16_t *buffer, uint16_t count, uint8_t rate, rak13015_burst_t *burst)
+{
+	rak13015_burst_t result = {0, 0, 0.0, 0, count};
+	if ((channel >= RAK13015_NUM_CH) || (rate >= SGM58031_SPS_NUM) || (count == 0) ||
+		(_adc_read[adcIndex(channel)].state == READ_CONVERTING) || isAcquiring(channel))
+	{
+		RAK13015_LOG("BURST", "Invalid channel or rate or ADC busy");
+		if (burst != NULL)
+		{
+			*burst = result;
+		}
+		return count;
+	}
+
+	// Pace the capture on the conversion ready edges if the ALERT pin is free
+	RAK_ADC_SGM58031 &adc = adcOf(channel);
+	bool alert_free = (_acq_channel == RAK13015_NUM_CH) &&
+					  (_window_channel[0] == RAK13015_NUM_CH) && (_window_channel[1] == RAK13015_NUM_CH);
+	bool paced = (_alert_pin != -1) && alert_free && claimAlert();
+	if (paced)
+	{
+		adcOf(adcIndex(channel) ? RAK13015_CH_4_20_0 : RAK13015_CH_ANA_1).setReadyPin(-1);
+		adc.setReadyPin(_alert_pin);
+		_burst_adc = &adc;
+		attachInterrupt(digitalPinToInterrupt(_alert_pin), _isr_entry[_isr_slot], FALLING);
+	}
+	else
+	{
+		// Nobody counts the edges, serviceContinuous() falls back to the nominal conversion clock
+		adc.setReadyPin(-1);
+	}
+
+	// Configure once, the conversion register is read without changing the register pointer again
+	uint16_t config = (_channel_config[channel] & ~SGM58031_CONFIG_DR) | adc.selectSampleRate(rate);
+	uint32_t timeout = adc.getConversionTime(config) * 4;
+	adc.startContinuous(config);
+	uint32_t last = 0;
+	uint32_t waiting = micros();
+	uint16_t lost_first = 0;
+	uint16_t sample;
+	while (result.samples < count)
+	{
+		if (adc.serviceContinuous() == 0)
+		{
+			if ((micros() - waiting) > timeout)
+			{
+				RAK13015_LOG("BURST", "No conversion ready edge");
+				break;
+			}
+			continue;
+		}
+		waiting = micros();
+		last = paced ? (uint32_t)_acq_edge_time : waiting;
+		if (result.samples == 0)
+		{
+			result.start_us = last;
+			lost_first = adc.getSamplesLost();
+		}
+		adc.readSamples(&sample, 1);
+		buffer[result.samples++] = (int16_t)sample;
+	}
+	if (paced)
+	{
+		releaseAlert();
+		_burst_adc = NULL;
+	}
+	adc.stopContinuous();
+	if (alert_free)
+	{
+		// Back to the conversion ready detection selected with useAlertReady()
+		useAlertReady(_alert_ready);
+	}
+
+	result.missed = adc.getSamplesLost();
+	result.duration_us = last - result.start_us;
+	if ((result.samples > 1) && (result.duration_us != 0))
+	{
+		// Conversions between the first and the last sample
+		result.rate = (result.samples - 1 + result.missed - lost_first) * 1000000.0 / result.duration_us;
+	}
+	RAK13015_LOG("BURST", "CH%d %d samples %.1f SPS %d missed", channel, result.samples, result.rate, result.missed);
+	if (burst != NULL)
+	{
+		*burst = result;
+	}
+	if (result.samples < count)
+	{
+		return count;
+	}
+	return result.missed;
+}
+
+bool RAK13015::claimAlert(void)
+{
+	if (_isr_slot != RAK13015_MAX_MODULES)
+	{
+		return true;
+	}
+	uint8_t free_slot = RAK13015_MAX_MODULES;
+	for (uint8_t slot = 0; slot < RAK13015_MAX_MODULES; slot++)
+	{
+		if (_isr_owner[slot] == NULL)
+		{
+			if (free_slot == RAK13015_MAX_MODULES)
+			{
+				free_slot = slot;
+			}
+		}
+		else if (_isr_owner[slot]->_alert_pin == _alert_pin)
+		{
+			RAK13015_LOG("RAK13015", "ALERT pin used by another module");
+			return false;
+		}
+	}
+	if (free_slot == RAK13015_MAX_MODULES)
+	{
+		RAK13015_LOG("RAK13015", "No free interrupt, increase RAK13015_MAX_MODULES");
+		return false;
+	}
+	_isr_owner[free_slot] = this;
+	_isr_slot = free_slot;
+	return true;
+}
+
+void RAK13015::releaseAlert(void)
+{
+	if (_isr_slot == RAK13015_MAX_MODULES)
+	{
+		return;
+	}
+	detachInterrupt(digitalPinToInterrupt(_alert_pin));
+	_isr_owner[_isr_slot] = NULL;
+	_isr_slot = RAK13015_MAX_MODULES;
+}
+
+void RAK13015::onAlert(void)
+{
+	if (_burst_adc != NULL)
+	{
+		// Conversion ready edge of a burst capture, the sample is read by captureBurst()
+		_acq_edge_time = micros();
+		_burst_adc->conversionReady();
+		return;
+	}
+	if (_acq_channel == RAK13015_NUM_CH)
+	{
+		// Window comparator alert, both ADCs share the ALERT line, the source is not known here
+		if (_window_callback[0] != NULL)
+		{
+			_window_callback[0]();
+		}
+		if ((_window_callback[1] != NULL) && (_window_callback[1] != _window_callback[0]))
+		{
+			_window_callback[1]();
+		}
+		return;
+	}
+#if RAK13015_I2C_IN_ISR > 0
+	rak13015_sample_t sample;
+	sample.timestamp = micros();
+	sample.raw = readRaw(_acq_channel);
+	sample.channel = _acq_channel;
+	_acq_queue.push(sample);
+#else
+	// Defer the I2C access to serviceAcquisition()
+	_acq_edge_time = micros();
+	_acq_edges++;
+#endif
+}
+
+bool RAK13015::isAcquiring(uint8_t channel)
+{
+	if (_window_channel[adcIndex(channel)] != RAK13015_NUM_CH)
+	{
+		return true;
+	}
+	return (_acq_channel != RAK13015_NUM_CH) && (adcIndex(_acq_channel) == adcIndex(channel));
+}
+
+bool RAK13015::setAlertWindow(uint8_t channel, float low, float high, void (*callback)(void), uint16_t data_rate)
+{
+	if ((channel >= RAK13015_NUM_CH) || (_alert_pin == -1) || (low >= high))
+	{
+		RAK13015_LOG("WIN", "Invalid window or no ALERT pin on this slot");
+		return false;
+	}
+	uint8_t adc_idx = adcIndex(channel);
+	if ((_acq_channel != RAK13015_NUM_CH) || (_adc_read[adc_idx].state == READ_CONVERTING))
+	{
+		RAK13015_LOG("WIN", "ADC or ALERT pin busy");
+		return false;
+	}
+	if (!claimAlert())
+	{
+		return false;
+	}
+	RAK_ADC_SGM58031 &adc = adcOf(channel);
+	if (_window_channel[adc_idx] != RAK13015_NUM_CH)
+	{
+		adc.stopContinuous();
+	}
+
+	// The ALERT line is driven by the window comparator, conversion ready is detected by polling
+	adc.setReadyPin(-1);
+	if (_window_channel[adc_idx ^ 1] == RAK13015_NUM_CH)
+	{
+		adcOf(adc_idx ? RAK13015_CH_4_20_0 : RAK13015_CH_ANA_1).setReadyPin(-1);
+	}
+
+	selectChannel(channel);
+	_window_low[adc_idx] = toRaw(channel, low);
+	_window_high[adc_idx] = toRaw(channel, high);
+	adc.setAlertLowThreshold((uint16_t)_window_low[adc_idx]);
+	adc.setAlertHighThreshold((uint16_t)_window_high[adc_idx]);
+
+	_window_channel[adc_idx] = channel;
+	_window_callback[adc_idx] = callback;
+	attachInterrupt(digitalPinToInterrupt(_alert_pin), _isr_entry[_isr_slot], FALLING);
+
+	// Window comparator, ALERT active low, latching, assert after one conversion
+	uint16_t config = _channel_config[channel] & ~(SGM58031_CONFIG_DR | SGM58031_CONFIG_COMP_MODE | SGM58031_CONFIG_COMP_POL | SGM58031_CONFIG_COMP_LAT | SGM58031_CONFIG_COMP_QUE);
+	config |= (data_rate & SGM58031_CONFIG_DR) | SGM58031_CONFIG_COMP_MODE | SGM58031_CONFIG_COMP_LAT;
+	adc.startContinuous(config);
+	return true;
+}
+
+void RAK13015::clearAlertWindow(uint8_t channel)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return;
+	}
+	uint8_t adc_idx = adcIndex(channel);
+	if (_window_channel[adc_idx] != channel)
+	{
+		return;
+	}
+	RAK_ADC_SGM58031 &adc = adcOf(channel);
+	adc.stopContinuous();
+	// Disable the comparator to release the ALERT line
+	adc.setConfig(_channel_config[channel] & ~SGM58031_CONFIG_OS);
+	_window_channel[adc_idx] = RAK13015_NUM_CH;
+	_window_callback[adc_idx] = NULL;
+
+	if (_window_channel[adc_idx ^ 1] == RAK13015_NUM_CH)
+	{
+		releaseAlert();
+		// Back to the conversion ready detection selected with useAlertReady()
+		useAlertReady(_alert_ready);
+	}
+}
+
+uint8_t RAK13015::checkAlertWindow(float *values)
+{
+	uint8_t events = 0;
+	for (uint8_t adc_idx = 0; adc_idx < 2; adc_idx++)
+	{
+		uint8_t channel = _window_channel[adc_idx];
+		if (channel == RAK13015_NUM_CH)
+		{
+			continue;
+		}
+		RAK_ADC_SGM58031 &adc = adcOf(channel);
+		// Reading the conversion register clears the latched ALERT
+		int16_t raw = (int16_t)adc.getAdcValue();
+		if ((raw <= _window_low[adc_idx]) || (raw >= _window_high[adc_idx]))
+		{
+			events |= 1 << channel;
+			_values[channel] = toValue(channel, raw);
+			_range_used[channel] = _channel_config[channel] & SGM58031_CONFIG_PGA;
+			_raw_used[channel] = raw;
+			if (values != NULL)
+			{
+				values[channel] = _values[channel];
+			}
+			RAK13015_LOG("WIN", "CH%d out of window: %.2f", channel, _values[channel]);
+		}
+	}
+	return events;
+}
+
+bool RAK13015::useAlertReady(bool use_alert_pin)
+{
+	if (_acq_channel != RAK13015_NUM_CH)
+	{
+		RAK13015_LOG("RAK13015", "ALERT pin used by acquisition");
+		return false;
+	}
+	if ((_window_channel[0] != RAK13015_NUM_CH) || (_window_channel[1] != RAK13015_NUM_CH))
+	{
+		// The ready mode uses the threshold registers of the window
+		RAK13015_LOG("RAK13015", "ALERT pin used by window monitoring");
+		return false;
+	}
+	if (!use_alert_pin)
+	{
+		_ad0.setReadyPin(-1);
+		_ad1.setReadyPin(-1);
+		_alert_ready = false;
+		return true;
+	}
+	if (_alert_pin == -1)
+	{
+		RAK13015_LOG("RAK13015", "No ALERT pin on this slot");
+		return false;
+	}
+	_ad0.setReadyPin(_alert_pin);
+	_ad1.setReadyPin(_alert_pin);
+	_alert_ready = true;
+	return true;
+}
+
+bool RAK13015::setDataRate(uint8_t channel, uint16_t data_rate)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return false;
+	}
+	_channel_config[channel] = (_channel_config[channel] & ~SGM58031_CONFIG_DR) | (data_rate & SGM58031_CONFIG_DR);
+	_channel_dr_sel &= ~(1 << channel);
+	return true;
+}
+
+uint16_t RAK13015::getDataRate(uint8_t channel)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return 0xFFFF;
+	}
+	return _channel_config[channel] & SGM58031_CONFIG_DR;
+}
+
+bool RAK13015::setSampleRate(uint8_t channel, uint8_t rate)
+{
+	if ((channel >= RAK13015_NUM_CH) || (rate >= SGM58031_SPS_NUM))
+	{
+		return false;
+	}
+	_channel_config[channel] = (_channel_config[channel] & ~SGM58031_CONFIG_DR) | ((uint16_t)(rate & 0x07) << 5);
+	if (rate & SGM58031_SPS_DR_SEL)
+	{
+		_channel_dr_sel |= 1 << channel;
+	}
+	else
+	{
+		_channel_dr_sel &= ~(1 << channel);
+	}
+	return true;
+}
+
+uint8_t RAK13015::getSampleRate(uint8_t channel)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return 0xFF;
+	}
+	uint8_t rate = (_channel_config[channel] & SGM58031_CONFIG_DR) >> 5;
+	if (_channel_dr_sel & (1 << channel))
+	{
+		rate |= SGM58031_SPS_DR_SEL;
+	}
+	return rate;
+}
+
+bool RAK13015::setFilter(uint8_t channel, uint8_t type, uint8_t depth)
+{
+	if ((channel >= RAK13015_NUM_CH) || (type > RAK13015_FILTER_IIR))
+	{
+		return false;
+	}
+	_filter[channel].setup(type, depth);
+	return true;
+}
+
+void RAK13015::resetFilter(uint8_t channel)
+{
+	if (channel < RAK13015_NUM_CH)
+	{
+		_filter[channel].reset();
+	}
+}
+
+bool RAK13015::setAutoRange(uint8_t channel, bool enable)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return false;
+	}
+	if (enable)
+	{
+		_auto_range |= 1 << channel;
+		_range_peak[channel] = 0.0;
+	}
+	else
+	{
+		_auto_range &= ~(1 << channel);
+	}
+	return true;
+}
+
+bool RAK13015::setRange(uint8_t channel, float full_scale)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return false;
+	}
+	_auto_range &= ~(1 << channel);
+	changeRange(channel, RAK_ADC_SGM58031::getPgaBits(full_scale));
+	return true;
+}
+
+float RAK13015::getRange(uint8_t channel)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return 0.0;
+	}
+	return RAK_ADC_SGM58031::getFullScale(_range_used[channel]);
+}
+
+int32_t RAK13015::toMicro(uint8_t channel, int16_t raw)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return 0;
+	}
+	return calibrate(channel, scale_fixed(raw, microScale(channel, _channel_config[channel])));
+}
+
+bool RAK13015::toMicro(uint8_t channel, const int16_t *raw, int32_t *micro, uint16_t count)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return false;
+	}
+	int64_t mult = microScale(channel, _channel_config[channel]);
+	for (uint16_t idx = 0; idx < count; idx++)
+	{
+		micro[idx] = calibrate(channel, scale_fixed(raw[idx], mult));
+	}
+	return true;
+}
+
+int32_t RAK13015::getMicro(uint8_t channel)
+{
+	if (channel >= RAK13015_NUM_CH)
+	{
+		return 0;
+	}
+	return calibrate(channel, scale_fixed(_raw_used[channel], microScale(channel, _range_used[channel])));
+}
+
+int64_t RAK13015::microScale(uint8_t channel, uint16_t pga)
+{
+	uint8_t idx = (pga & SGM58031_CONFIG_PGA) >> 9;
+	return channel <= RAK13015_CH_4_20_2 ? micro_4_20_mult[idx] : micro_ana_mult[idx];
+}
+
+float RAK13015::toValue(uint8_t channel, int16_t raw)
+{
+	if (!(_cal_mask & (1 << channel)))
+	{
+		return toEngineering(channel, toVoltage(channel, raw));
+	}
+	int32_t micro = calibrate(channel, scale_fixed(raw, microScale(channel, _channel_config[channel])));
+	// mA or V
+	return channel <= RAK13015_CH_4_20_2 ? micro / 1000.0 : micro / 1000000.0;
+}
+
+int32_t RAK13015::calibrate(uint8_t channel, int32_t micro)
+{
+	if (!(_cal_mask & (1 << channel)))
+	{
+		return micro;
+	}
+	cal_t &cal = _cal[channel];
+	int64_t value = clamp_int32((((int64_t)micro * cal.gain + (1 << 23)) >> 24) + cal.offset);
+	if (cal.points >= 2)
+	{
+		uint8_t seg = 0;
+		while ((seg < (cal.points - 2)) && (value >= cal.measured[seg + 1]))
+		{
+			seg++;
+		}
+		// Both factors fit 32 bit, the product fits 64 bit
+		value = clamp_int32(cal.actual[seg] + (((value - cal.measured[seg]) * cal.slope[seg] + (1 << 23)) >> 24));
+	}
+	return (int32_t)value;
+}
+
+bool RAK13015::setCalibration(uint8_t channel, int32_t offset, float gain, const int32_t *measured, const int32_t *actual, uint8_t points)
+{
+	// Also rejects NaN, the Q24 gain must fit an int32
+	if (!((gain > 0.0) && (gain < 128.0)))
+	{
+		return false;
+	}
+	return setCalibrationTable(channel, offset, (int32_t)(gain * 16777216.0 + 0.5), measured, actual, points);
+}
+
+bool RAK13015::setCalibrationTable(uint8_t channel, int32_t offset, int32_t gain, const int32_t *measured, const int32_t *actual, uint8_t points)
+{
+	if ((channel >= RAK13015_NUM_CH) || (gain <= 0) || (points == 1) || (points > RAK13015_CAL_POINTS) ||
+		((points != 0) && ((measured == NULL) || (actual == NULL))))
+	{
+		return false;
+	}
+	int32_t slope[RAK13015_CAL_POINTS - 1];
+	if (!cal_slopes(measured, actual, points, slope))
+	{
+		return false;
+	}
+
+	cal_t &cal = _cal[channel];
+	cal.offset = offset;
+	cal.gain = gain;
+	cal.points = points;
+	for (uint8_t idx = 0; idx < points; idx++)
+	{
+		cal.measured[idx] = measured[idx];
+		cal.actual[idx] = actual[idx];
+		if (idx > 0)
+		{
+			cal.slope[idx - 1] = slope[idx - 1];
+		}
+	}
+	_cal_mask |= 1 << channel;
+	return true;
+}
+
+void RAK13015::clearCalibration(uint8_t channel)
+{
+	if (channel < RAK13015_NUM_CH)
+	{
+		_cal_mask &= ~(1 << channel);
+	}
+}
+
+uint16_t RAK13015::saveCalibration(uint8_t *blob, uint16_t size)
+{
+	uint16_t needed = 4 + 2;
+	for (uint8_t channel = 0; channel < RAK13015_NUM_CH; channel++)
+	{
+		if (_cal_mask & (1 << channel))
+		{
+			needed += 9 + _cal[channel].points * 8;
+		}
+	}
+	if (blob == NULL)
+	{
+		return needed;
+	}
+	if (size < needed)
+	{
+		return 0;
+	}
+
+	uint16_t pos = 0;
+	blob[pos++] = CAL_MAGIC_0;
+	blob[pos++] = CAL_MAGIC_1;
+	blob[pos++] = CAL_VERSION;
+	blob[pos++] = _cal_mask;
+	for (uint8_t channel = 0; channel < RAK13015_NUM_CH; channel++)
+	{
+		if (!(_cal_mask & (1 << channel)))
+		{
+			continue;
+		}
+		cal_t &cal = _cal[channel];
+		blob[pos++] = cal.points;
+		put_int32(&blob[pos], cal.offset);
+		put_int32(&blob[pos + 4], cal.gain);
+		pos += 8;
+		for (uint8_t idx = 0; idx < cal.points; idx++)
+		{
+			put_int32(&blob[pos], cal.measured[idx]);
+			put_int32(&blob[pos + 4], cal.actual[idx]);
+			pos += 8;
+		}
+	}
+	uint16_t checksum = fletcher16(blob, pos);
+	blob[pos++] = (uint8_t)(checksum & 0xFF);
+	blob[pos++] = (uint8_t)(checksum >> 8);
+	return pos;
+}
+
+bool RAK13015::loadCalibration(const uint8_t *blob, uint16_t size)
+{
+	if ((blob == NULL) || (size < 6) || (blob[0] != CAL_MAGIC_0) || (blob[1] != CAL_MAGIC_1) ||
+		(blob[2] != CAL_VERSION) || (blob[3] >= (1 << RAK13015_NUM_CH)))
+	{
+		RAK13015_LOG("CAL", "Invalid calibration blob");
+		return false;
+	}
+	uint16_t checksum = blob[size - 2] | (blob[size - 1] << 8);
+	if (fletcher16(blob, size - 2) != checksum)
+	{
+		RAK13015_LOG("CAL", "Calibration checksum error");
+		return false;
+	}
+
+	// Check the structure before anything is applied
+	uint8_t mask = blob[3];
+	uint16_t pos = 4;
+	for (uint8_t channel = 0; channel < RAK13015_NUM_CH; channel++)
+	{
+		if (!(mask & (1 << channel)))
+		{
+			continue;
+		}
+		if ((pos + 9) > (size - 2))
+		{
+			return false;
+		}
+		uint8_t points = blob[pos];
+		if ((points == 1) || (points > RAK13015_CAL_POINTS) || (get_int32(&blob[pos + 5]) <= 0) ||
+			((pos + 9 + points * 8) > (size - 2)))
+		{
+			return false;
+		}
+		int32_t measured[RAK13015_CAL_POINTS];
+		int32_t actual[RAK13015_CAL_POINTS];
+		for (uint8_t idx = 0; idx < points; idx++)
+		{
+			measured[idx] = get_int32(&blob[pos + 9 + idx * 8]);
+			actual[idx] = get_int32(&blob[pos + 13 + idx * 8]);
+		}
+		if (!cal_slopes(measured, actual, points, NULL))
+		{
+			return false;
+		}
+		pos += 9 + points * 8;
+	}
+	if (pos != (size - 2))
+	{
+		return false;
+	}
+
+	_cal_mask = 0;
+	pos = 4;
+	for (uint8_t channel = 0; channel < RAK13015_NUM_CH; channel++)
+	{
+		if (!(mask & (1 << channel)))
+		{
+			continue;
+		}
+		int32_t measured[RAK13015_CAL_POINTS];
+		int32_t actual[RAK13015_CAL_POINTS];
+		uint8_t points = blob[pos];
+		for (uint8_t idx = 0; idx < points; idx++)
+		{
+			measured[idx] = get_int32(&blob[pos + 9 + idx * 8]);
+			actual[idx] = get_int32(&blob[pos + 13 + idx * 8]);
+		}
+		setCalibrationTable(channel, get_int32(&blob[pos + 1]), get_int32(&blob[pos + 5]), measured, actual, points);
+		pos += 9 + points * 8;
+	}
+	return true;
+}
+
+bool RAK13015::requestModBus(uint8_t slave_addr, uint16_t address, uint16_t num_coils, uint16_t *coils_regs, time_t timeout)
+{
+	rak13015_modbus_t transaction;
+	transaction.slave = slave_addr;				  // slave address
+	transaction.function = MB_FC_READ_REGISTERS; // function code (this one is registers read)
+	transaction.address = address;				  // start address in slave
+	transaction.count = num_coils;				  // number of elements (coils or registers) to read
+	transaction.regs = coils_regs;				  // pointer to a memory array
+	transaction.timeout = timeout > 0xFFFF ? 0xFFFF : timeout;
+	return waitModbus(transaction);
+}
+
+bool RAK13015::writeModBus(uint8_t slave_addr, uint16_t address, uint16_t num_coils, uint16_t *coils_regs, time_t timeout)
+{
+	rak13015_modbus_t transaction;
+	transaction.slave = slave_addr;						 // slave address
+	transaction.function = MB_FC_WRITE_MULTIPLE_COILS; // function code (this one is registers write)
+	transaction.address = address;						 // start address in slave
+	transaction.count = num_coils;						 // number of elements (coils or registers) to write
+	transaction.regs = coils_regs;						 // pointer to a memory array
+	transaction.timeout = timeout > 0xFFFF ? 0xFFFF : timeout;
+	return waitModbus(transaction);
+}
+
+bool RAK13015::waitModbus(rak13015_modbus_t &transaction)
+{
+	if (_mb_callbacks != 0)
+	{
+		// The wait loop would call serviceModbus() and the callbacks again from inside a callback
+		RAK13015_LOG("Mod", "Blocking request from a completion callback");
+		return false;
+	}
+	transaction.status = RAK13015_MB_IDLE;
+	if (!submitModbus(&transaction))
+	{
+		RAK13015_LOG("Mod", "Query failed");
+		return false;
+	}
+	// Transactions submitted before are finished first, each one ends at the latest with its timeout
+	while ((transaction.status == RAK13015_MB_QUEUED) || (transaction.status == RAK13015_MB_BUSY))
+	{
+		serviceModbus();
+	}
+	RAK13015_LOG("Mod", "Status %d result %d", transaction.status, transaction.result);
+	return transaction.status == RAK13015_MB_DONE;
+}
+
+bool RAK13015::submitModbus(rak13015_modbus_t *transaction, void (*callback)(rak13015_modbus_t *transaction))
+{
+	if ((transaction == NULL) || (transaction->status == RAK13015_MB_QUEUED) || (transaction->status == RAK13015_MB_BUSY) ||
+		(transaction->slave == 0) || (transaction->slave > 247))
+	{
+		return false;
+	}
+	transaction->callback = callback;
+	transaction->result = 0;
+	transaction->status = RAK13015_MB_QUEUED;
+	if (!_mb_queue.push(transaction))
+	{
+		RAK13015_LOG("Mod", "Transaction queue full");
+		transaction->status = RAK13015_MB_IDLE;
+		return false;
+	}
+	// Send the query right away if the bus is free
+	serviceModbus();
+	return true;
+}
+
+uint8_t RAK13015::serviceModbus(void)
+{
+	if (_mb_active != NULL)
+	{
+		// poll() returns 0 while waiting and on timeout, the frame size for a valid response or an error code
+		int16_t result = _master.poll();
+		if (_master.getState() == COM_WAITING)
+		{
+			return _mb_queue.count() + 1;
+		}
+		if (result == 0)
+		{
+			finishModbus(RAK13015_MB_TIMEOUT, result);
+		}
+		else if (result == ERR_EXCEPTION)
+		{
+			finishModbus(RAK13015_MB_EXCEPTION, _master.getLastError());
+		}
+		else if (result >= 6)
+		{
+			finishModbus(RAK13015_MB_DONE, result);
+		}
+		else
+		{
+			finishModbus(RAK13015_MB_ERROR, result);
+		}
+	}
+
+	while ((_mb_active == NULL) && _mb_queue.pop(_mb_active))
+	{
+		modbus_t telegram;
+		telegram.u8id = _mb_active->slave;
+		telegram.u8fct = _mb_active->function;
+		telegram.u16RegAdd = _mb_active->address;
+		telegram.u16CoilsNo = _mb_active->count;
+		telegram.au16reg = (int16_t *)_mb_active->regs;
+		_master.setTimeOut(_mb_active->timeout);
+		int8_t result = _master.query(telegram);
+		if (result != 0)
+		{
+			finishModbus(RAK13015_MB_ERROR, result);
+			continue;
+		}
+		_mb_active->status = RAK13015_MB_BUSY;
+	}
+	return _mb_queue.count() + (_mb_active != NULL ? 1 : 0);
+}
+
+void RAK13015::finishModbus(uint8_t status, int16_t result)
+{
+	rak13015_modbus_t *transaction = _mb_active;
+	// Released before the callback, the callback may submit the next transaction
+	_mb_active = NULL;
+	transaction->status = status;
+	transaction->result = result;
+	if (transaction->callback != NULL)
+	{
+		_mb_callbacks++;
+		transaction->callback(transaction);
+		_mb_callbacks--;
+	}
 }
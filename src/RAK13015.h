@@ -14,6 +14,8 @@
 #include <Arduino.h>
 #include "ADC_SGM58031.h"
 #include "ModbusRtu.h"
+#include "RAK13015_Queue.h"
+#include "RAK13015_Filter.h"
 
 // Debug output set to 0 to disable app debug output
 #ifndef RAK13015_DEBUG_MODE
@@ -45,6 +47,141 @@
 #define ANA_CH_0 0xF383
 #define ANA_CH_1 0xC383
 
+// Channel index for multi channel reads
+#define RAK13015_CH_4_20_0 0
+#define RAK13015_CH_4_20_1 1
+#define RAK13015_CH_4_20_2 2
+#define RAK13015_CH_ANA_0 3
+#define RAK13015_CH_ANA_1 4
+#define RAK13015_NUM_CH 5
+
+/**
+ * @brief Result of a read of all channels
+ */
+typedef struct
+{
+	float values[RAK13015_NUM_CH]; //!< Currents in mA, voltages in volt, -50.0 if the conversion failed
+	int16_t raw[RAK13015_NUM_CH];  //!< Raw ADC counts, filtered if a filter is set for the channel
+	float range[RAK13015_NUM_CH];  //!< ADC full scale range in volt of the raw counts
+	int32_t micro[RAK13015_NUM_CH]; //!< Currents in uA, voltages in uV, integer conversion of the raw counts
+	uint8_t valid;				   //!< Channels read successfully, bit n is channel index n
+} rak13015_snapshot_t;
+
+/**
+ * @brief Statistics of initAnalog_4_20()
+ */
+typedef struct
+{
+	uint32_t last_us;	 //!< Duration of the last init in us
+	uint32_t max_us;	 //!< Longest successful init in us
+	uint16_t cold;		 //!< Inits that probed the ADCs
+	uint16_t warm;		 //!< Warm inits that skipped the probing
+	uint16_t failed;	 //!< Inits that did not find both ADCs
+	uint16_t chip_id[2]; //!< Chip ID register of the first (0x49) and second (0x48) ADC at the last probe
+} rak13015_init_stats_t;
+
+// Number of samples in the interrupt acquisition queue, must be a power of 2
+#ifndef RAK13015_QUEUE_SIZE
+#define RAK13015_QUEUE_SIZE 64
+#endif
+
+// Set to 1 to read the conversion result directly in the ALERT interrupt.
+// Only if the I2C driver of the platform can be used from an ISR
+#ifndef RAK13015_I2C_IN_ISR
+#define RAK13015_I2C_IN_ISR 0
+#endif
+
+// Auto-ranging: a reading at or above this magnitude in raw counts is saturated and measured again in the next larger range
+#ifndef RAK13015_RANGE_SATURATION
+#define RAK13015_RANGE_SATURATION 32000
+#endif
+// Auto-ranging: a smaller range is used if the recent magnitude is below this percentage of its full scale
+#ifndef RAK13015_RANGE_HEADROOM
+#define RAK13015_RANGE_HEADROOM 75
+#endif
+
+// Maximum number of points of the piecewise linear calibration table of a channel
+#ifndef RAK13015_CAL_POINTS
+#define RAK13015_CAL_POINTS 8
+#endif
+// Maximum size of the calibration blob of saveCalibration() in bytes
+#define RAK13015_CAL_BLOB_SIZE (4 + RAK13015_NUM_CH * (9 + RAK13015_CAL_POINTS * 8) + 2)
+
+// Maximum filter window of a channel in samples
+#ifndef RAK13015_FILTER_DEPTH
+#define RAK13015_FILTER_DEPTH 16
+#endif
+
+// Maximum number of modules using their ALERT interrupt at the same time, 1 ... 4
+#ifndef RAK13015_MAX_MODULES
+#define RAK13015_MAX_MODULES 2
+#endif
+
+/**
+ * @brief Sample of the interrupt driven acquisition
+ */
+typedef struct
+{
+	uint32_t timestamp; //!< micros() of the conversion ready edge
+	int16_t raw;		//!< Raw ADC count, filtered if a filter is set for the channel
+	uint8_t channel;	//!< Channel index
+} rak13015_sample_t;
+
+/**
+ * @brief Result of a burst capture
+ */
+typedef struct
+{
+	uint32_t start_us;	  //!< micros() of the conversion ready edge of the first sample, of its read without ALERT pin
+	uint32_t duration_us; //!< Time from the first to the last sample in us
+	float rate;			  //!< Effective samples per second, including missed conversions
+	uint16_t samples;	  //!< Samples written to the buffer
+	uint16_t missed;	  //!< Conversions overwritten before they were read
+} rak13015_burst_t;
+
+/**
+ * @brief Statistics of a channel since the last reset
+ */
+typedef struct
+{
+	uint32_t count; //!< Number of readings
+	float min;		//!< Smallest reading, mA or V
+	float max;		//!< Largest reading, mA or V
+	float mean;		//!< Mean of the readings, mA or V
+	float variance; //!< Sample variance of the readings, 0 if less than 2 readings
+	float stddev;	//!< Sample standard deviation of the readings, 0 if less than 2 readings
+} rak13015_stats_t;
+
+// Number of queued Modbus transactions + 1, must be a power of 2
+#ifndef RAK13015_MODBUS_QUEUE
+#define RAK13015_MODBUS_QUEUE 8
+#endif
+
+// Status of a Modbus transaction
+#define RAK13015_MB_IDLE 0		//!< not submitted
+#define RAK13015_MB_QUEUED 1	//!< waiting for the transactions submitted before
+#define RAK13015_MB_BUSY 2		//!< query sent, waiting for the response
+#define RAK13015_MB_DONE 3		//!< valid response received
+#define RAK13015_MB_EXCEPTION 4 //!< slave answered with an exception
+#define RAK13015_MB_TIMEOUT 5	//!< no response within the timeout
+#define RAK13015_MB_ERROR 6		//!< query could not be sent or the response was invalid (CRC, size)
+
+/**
+ * @brief Asynchronous Modbus transaction, the memory must stay valid until the transaction is finished
+ */
+typedef struct rak13015_modbus_s
+{
+	uint8_t slave;											//!< Slave address 1 ... 247
+	uint8_t function;										//!< MB_FC_READ_COILS ... MB_FC_WRITE_MULTIPLE_REGISTERS
+	uint16_t address;										//!< Register/Coil start address
+	uint16_t count;											//!< Number of registers/coils
+	uint16_t *regs;											//!< Buffer for the data read or with the data to write
+	uint16_t timeout;										//!< Timeout in ms for the response
+	uint8_t status;											//!< RAK13015_MB_IDLE ... RAK13015_MB_ERROR
+	int16_t result;											//!< Return value of the Modbus query() or poll(), exception code of the slave for RAK13015_MB_EXCEPTION
+	void (*callback)(struct rak13015_modbus_s *transaction); //!< Called when the transaction is finished, set by submitModbus()
+} rak13015_modbus_t;
+
 // Base Board Slots
 #define SLOT_A 0
 #define SLOT_B 1
@@ -91,19 +228,28 @@ public:
 	 *
 	 * @param slot WisBlock Base Board Slot. Possible SLOT_A ... SLOT_F
 	 * @param base_board WisBlock Base Board used. Possible values RAK19007 RAK19003 RAK19001
+	 * @param wire I2C bus of the module. The ADC addresses are fixed, each module needs its own bus
 	 *
 	 * @par Usage
 	 * @code
 	 * RAK13015 rak_in(SLOT_D, RAK19007); // Use Slot D on RAk19007
+	 * // Two modules on RAK19001, each with its own I2C bus and UART
+	 * RAK13015 rak_in_d(SLOT_D, RAK19001, Wire);
+	 * RAK13015 rak_in_e(SLOT_E, RAK19001, Wire1);
 	 * @endcode
 	 */
-	RAK13015(uint8_t slot, uint8_t base_board);
+	RAK13015(uint8_t slot, uint8_t base_board, TwoWire &wire = Wire) : RAK13015(slot, base_board, wire, sizeof(RAK13015)) {}
+
+	/**
+	 * @brief Destroy the RAK13015 object, releases its ALERT interrupt
+	 */
+	~RAK13015();
 
 	/**
 	 * @brief Initialize RAK13015.
 	 * 		Initializes Analog inputs, 4-20mA inputs and RS485 as simple ModBus RTU master
 	 *
-	 * @param analog_resolution ADC resolution. Possible values SGM58031_FS_6_144 SGM58031_FS_4_096 SGM58031_FS_2_048 SGM58031_FS_1_024 SGM58031_FS_0_512 SGM58031_FS_0_256
+	 * @param analog_resolution ADC full scale range of all channels (PGA). Possible values SGM58031_FS_6_144 SGM58031_FS_4_096 SGM58031_FS_2_048 SGM58031_FS_1_024 SGM58031_FS_0_512 SGM58031_FS_0_256
 	 * @param baud Baudrate for RS485
 	 * @return true if initialization was successfull
 	 * @return false if slot/base board selection is invalid or initialization failed
@@ -125,9 +271,13 @@ public:
 
 	/**
 	 * @brief Initialize Analog inputs and 4-20mA inputs only.
-	 * 		Use when RS485 is setup with other RS485/Modbus drivers
+	 * 		Use when RS485 is setup with other RS485/Modbus drivers.
+	 * 		Only the two ADC addresses are probed, each ADC is verified with its chip ID.
+	 * 		A warm init skips the probing if the ADCs were verified before and the module stayed powered,
+	 * 		e.g. after a wake up from sleep. Use a cold init after the module was powered down.
 	 *
-	 * @param resolution  ADC resolution. Possible values SGM58031_FS_6_144 SGM58031_FS_4_096 SGM58031_FS_2_048 SGM58031_FS_1_024 SGM58031_FS_0_512 SGM58031_FS_0_256
+	 * @param resolution  ADC full scale range of all channels (PGA). Possible values SGM58031_FS_6_144 SGM58031_FS_4_096 SGM58031_FS_2_048 SGM58031_FS_1_024 SGM58031_FS_0_512 SGM58031_FS_0_256
+	 * @param warm true to skip the probing if the ADCs were already verified, false to probe the ADCs
 	 * @return true if initialization was successfull
 	 * @return false if slot/base board selection is invalid or initialization failed
 	 *
@@ -142,9 +292,25 @@ public:
 	 * {
 	 * 	Serial.println("No RAK13015 found");
 	 * }
+	 * // After wake up from sleep, module power was not switched off
+	 * rak_in.initAnalog_4_20(SGM58031_FS_4_096, true);
+	 * @endcode
+	 */
+	bool initAnalog_4_20(float resolution = SGM58031_FS_4_096, bool warm = false);
+
+	/**
+	 * @brief Get the statistics of initAnalog_4_20(), e.g. to track the boot latency
+	 *
+	 * @param stats Receives the statistics
+	 *
+	 * @par Usage
+	 * @code
+	 * rak13015_init_stats_t stats;
+	 * rak_in.getInitStats(stats);
+	 * Serial.printf("Init %ld us, %d cold, %d warm\r\n", stats.last_us, stats.cold, stats.warm);
 	 * @endcode
 	 */
-	bool initAnalog_4_20(float resolution = SGM58031_FS_4_096);
+	void getInitStats(rak13015_init_stats_t &stats);
 
 	/**
 	 * @brief Read analog port.
@@ -203,6 +369,575 @@ public:
 	 */
 	float read4_20ma(uint16_t port);
 
+	/**
+	 * @brief Read all 4-20mA and analog ports.
+	 * 		The conversion of ANA_CH_1 on the second ADC runs while the first ADC converts its four channels
+	 *
+	 * @param values Array of RAK13015_NUM_CH values, sorted by channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * 		Currents are in mA, voltages in volt, -50.0 if the conversion failed
+	 * @return true if all channels were read
+	 * @return false if a conversion timed out
+	 *
+	 * @par Usage
+	 * @code
+	 * float a_4_20[RAK13015_NUM_CH];
+	 * if (rak_in.scanAll(a_4_20))
+	 * {
+	 * 	Serial.printf("4-20mA CH0 : %.2f\r\n", a_4_20[RAK13015_CH_4_20_0]);
+	 * 	Serial.printf("Analog CH1 : %.2f\r\n", a_4_20[RAK13015_CH_ANA_1]);
+	 * }
+	 * @endcode
+	 */
+	bool scanAll(float *values);
+
+	/**
+	 * @brief Read all 4-20mA and analog ports into a snapshot.
+	 * 		Runs a fixed sequence over the multiplexer of the first ADC. The next channel is programmed
+	 * 		as soon as the current result is latched, the result is read while the next conversion runs.
+	 * 		ANA_CH_1 on the second ADC converts in parallel to the whole sequence.
+	 *
+	 * @param snapshot Receives engineering values and raw counts, sorted by channel index
+	 * @return true if all channels were read
+	 * @return false if a conversion timed out or a non-blocking read is running
+	 *
+	 * @par Usage
+	 * @code
+	 * rak13015_snapshot_t snapshot;
+	 * if (rak_in.readAll(snapshot))
+	 * {
+	 * 	Serial.printf("4-20mA CH0 : %.2f mA raw %d\r\n", snapshot.values[RAK13015_CH_4_20_0], snapshot.raw[RAK13015_CH_4_20_0]);
+	 * 	Serial.printf("Analog CH1 : %.2f V raw %d\r\n", snapshot.values[RAK13015_CH_ANA_1], snapshot.raw[RAK13015_CH_ANA_1]);
+	 * }
+	 * @endcode
+	 */
+	bool readAll(rak13015_snapshot_t &snapshot);
+
+	/**
+	 * @brief Read all 4-20mA and analog ports of several modules in one interleaved pass.
+	 * 		The sequences of all modules run in lockstep, each step starts the next conversion on every module
+	 * 		before the results are read. The scan takes about as long as readAll() of a single module
+	 * 		instead of growing with the number of modules.
+	 *
+	 * @param modules Array of modules, each on its own I2C bus
+	 * @param count Number of modules
+	 * @param snapshots Array of count snapshots, receives the readings of each module like readAll()
+	 * @return uint8_t number of modules with all channels read, modules that are busy are skipped
+	 *
+	 * @par Usage
+	 * @code
+	 * RAK13015 *modules[2] = {&rak_in_d, &rak_in_e};
+	 * rak13015_snapshot_t snapshots[2];
+	 * if (RAK13015::readModules(modules, 2, snapshots) == 2)
+	 * {
+	 * 	Serial.printf("Slot D 4-20mA CH0 : %.2f mA\r\n", snapshots[0].values[RAK13015_CH_4_20_0]);
+	 * 	Serial.printf("Slot E 4-20mA CH0 : %.2f mA\r\n", snapshots[1].values[RAK13015_CH_4_20_0]);
+	 * }
+	 * @endcode
+	 */
+	static uint8_t readModules(RAK13015 *modules[], uint8_t count, rak13015_snapshot_t snapshots[]);
+
+	/**
+	 * @brief Start a non-blocking read of a channel.
+	 * 		Each ADC can run one read at a time, ANA_CH_1 is on the second ADC and can run in parallel with the other channels.
+	 * 		Poll isReady() and get the result with fetch(), the loop is never blocked
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @return true if the conversion was started
+	 * @return false if the channel is invalid or the ADC is busy with another read
+	 *
+	 * @par Usage
+	 * @code
+	 * // Start the conversion
+	 * rak_in.startRead(RAK13015_CH_4_20_0);
+	 * // ... handle other events and come back later
+	 * if (rak_in.isReady(RAK13015_CH_4_20_0))
+	 * {
+	 * 	Serial.printf("4-20mA CH0 : %.2f\r\n", rak_in.fetch(RAK13015_CH_4_20_0));
+	 * }
+	 * @endcode
+	 */
+	bool startRead(uint8_t channel);
+
+	/**
+	 * @brief Check if a non-blocking read has finished.
+	 * 		A timed out conversion is reported as ready, fetch() returns -50.0 in that case
+	 *
+	 * @param channel Channel index used with startRead()
+	 * @return true if the result can be fetched
+	 * @return false if the conversion is still running or no read was started for this channel
+	 */
+	bool isReady(uint8_t channel);
+
+	/**
+	 * @brief Get the result of a non-blocking read.
+	 * 		Releases the ADC for the next startRead()
+	 *
+	 * @param channel Channel index used with startRead()
+	 * @return float Measured current in mA or voltage in volt, -50.0 if the read is not finished or timed out
+	 */
+	float fetch(uint8_t channel);
+
+	/**
+	 * @brief Start interrupt driven acquisition of one channel.
+	 * 		The ADC runs in continuous conversion and pulses the ALERT/RDY pin at the end of each conversion.
+	 * 		The conversion result is read by serviceAcquisition() (or in the ISR if RAK13015_I2C_IN_ISR is 1)
+	 * 		and queued in a lock-free queue that is drained with readAcquisition().
+	 * 		The other channels of the same ADC cannot be read while the acquisition runs.
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param data_rate ADC data rate SGM58031_DR_6_25 ... SGM58031_DR_800
+	 * @return true if the acquisition was started
+	 * @return false if the channel is invalid, the slot has no ALERT pin or an acquisition or read is running
+	 *
+	 * @par Usage
+	 * @code
+	 * rak13015_sample_t samples[32];
+	 * rak_in.startAcquisition(RAK13015_CH_4_20_0, SGM58031_DR_200);
+	 * // in loop() or a worker task
+	 * rak_in.serviceAcquisition();
+	 * // in loop()
+	 * uint16_t num_samples = rak_in.readAcquisition(samples, 32);
+	 * @endcode
+	 */
+	bool startAcquisition(uint8_t channel, uint16_t data_rate = SGM58031_DR_100);
+
+	/**
+	 * @brief Stop the interrupt driven acquisition.
+	 * 		The ADC goes back to single-shot mode, samples in the queue can still be read
+	 */
+	void stopAcquisition(void);
+
+	/**
+	 * @brief Read the conversion result after an ALERT/RDY interrupt.
+	 * 		Call frequently from loop() or from a worker task, at least once per conversion period.
+	 * 		Not required if RAK13015_I2C_IN_ISR is 1
+	 *
+	 * @return uint16_t number of samples added to the queue
+	 */
+	uint16_t serviceAcquisition(void);
+
+	/**
+	 * @brief Get the samples of the interrupt driven acquisition, oldest first
+	 *
+	 * @param samples Buffer for the samples
+	 * @param max_samples Size of the buffer
+	 * @return uint16_t number of samples copied
+	 */
+	uint16_t readAcquisition(rak13015_sample_t *samples, uint16_t max_samples);
+
+	/**
+	 * @brief Get the number of samples lost since the acquisition was started
+	 *
+	 * @return uint16_t conversions missed by serviceAcquisition() plus samples dropped because the queue was full
+	 */
+	uint16_t getAcquisitionLost(void);
+
+	/**
+	 * @brief Capture a burst of raw samples of one channel, e.g. a transient after a pump start.
+	 * 		The ADC is configured once and converts continuously, each sample costs a single I2C read.
+	 * 		The raw counts are not filtered and the channel keeps its range, use toMicro() to convert them.
+	 * 		Blocks until the buffer is full, count / sample rate seconds.
+	 * 		If the ALERT pin of the slot is free, each sample is read after the conversion ready edge and the
+	 * 		rate and missed conversions are measured from the edges. Otherwise a new sample is assumed every
+	 * 		nominal conversion period, the oscillator tolerance of +-10 % makes rate and missed an estimate.
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param buffer Buffer for count raw samples
+	 * @param count Number of samples to capture
+	 * @param rate Sample rate SGM58031_SPS_6_25 ... SGM58031_SPS_960
+	 * @param burst Receives start time, effective sample rate and missed conversions, can be NULL
+	 * @return uint16_t number of missed conversions, count if the burst could not be started or no conversion ready edge arrived
+	 *
+	 * @par Usage
+	 * @code
+	 * int16_t transient[256];
+	 * rak13015_burst_t burst;
+	 * uint16_t missed = rak_in.captureBurst(RAK13015_CH_4_20_0, transient, 256, SGM58031_SPS_960, &burst);
+	 * Serial.printf("%d samples at %.1f SPS, %d missed\r\n", burst.samples, burst.rate, missed);
+	 * @endcode
+	 */
+	uint16_t captureBurst(uint8_t channel, int16_t *buffer, uint16_t count, uint8_t rate = SGM58031_SPS_960, rak13015_burst_t *burst = NULL);
+
+	/**
+	 * @brief Start report-by-exception monitoring of a channel with the ADC window comparator.
+	 * 		The ADC converts continuously at a low data rate and asserts the ALERT pin when the value leaves
+	 * 		the window. The MCU only has to wake up on the ALERT interrupt and call checkAlertWindow().
+	 * 		One channel per ADC can be monitored, ANA_CH_1 (second ADC) can be monitored together with one of the other channels.
+	 * 		The other channels of the same ADC cannot be read while the monitoring runs.
+	 * 		The alert is latched, it is cleared by checkAlertWindow() and asserts again after the next conversion
+	 * 		as long as the value is outside of the window.
+	 * 		Each ADC keeps its own callback, clearAlertWindow() removes only the callback of its channel.
+	 * 		Both ADCs share the ALERT line, an alert calls the callbacks of both monitored channels
+	 * 		(a function used for both only once), checkAlertWindow() tells which channel left its window.
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param low Lower limit in mA or volt
+	 * @param high Upper limit in mA or volt
+	 * @param callback Function called from the ALERT interrupt, e.g. to wake up the application task, can be NULL
+	 * @param data_rate ADC data rate SGM58031_DR_6_25 ... SGM58031_DR_800
+	 * @return true if the monitoring was started
+	 * @return false if the parameters are invalid, the slot has no ALERT pin or the ADC is busy
+	 *
+	 * @par Usage
+	 * @code
+	 * void alert_wake(void)
+	 * {
+	 * 	api_wake_loop(ALERT_EVENT);
+	 * }
+	 * // Wake up only if the 4-20mA loop is outside of 4.5 ... 19 mA
+	 * rak_in.setAlertWindow(RAK13015_CH_4_20_0, 4.5, 19.0, alert_wake);
+	 * // In the event handler
+	 * float values[RAK13015_NUM_CH];
+	 * uint8_t events = rak_in.checkAlertWindow(values);
+	 * if (events & (1 << RAK13015_CH_4_20_0))
+	 * {
+	 * 	Serial.printf("4-20mA CH0 out of range: %.2f mA\r\n", values[RAK13015_CH_4_20_0]);
+	 * }
+	 * @endcode
+	 */
+	bool setAlertWindow(uint8_t channel, float low, float high, void (*callback)(void) = NULL, uint16_t data_rate = SGM58031_DR_6_25);
+
+	/**
+	 * @brief Stop the window comparator monitoring of a channel.
+	 *
+	 * @param channel Channel index used with setAlertWindow()
+	 */
+	void clearAlertWindow(uint8_t channel);
+
+	/**
+	 * @brief Check which monitored channels are outside of their window.
+	 * 		Reads the conversion results, this clears the latched ALERT
+	 *
+	 * @param values Optional array of RAK13015_NUM_CH values, receives the value of channels outside of their window
+	 * @return uint8_t bit mask of channels outside of their window, bit n is channel index n
+	 */
+	uint8_t checkAlertWindow(float *values = NULL);
+
+	/**
+	 * @brief Select how the end of an ADC conversion is detected.
+	 * 		By default the OS bit of the ADC config register is polled over I2C.
+	 * 		With the ALERT/RDY pin the I2C bus is only accessed once the pin is asserted.
+	 * 		Call after initRAK13015() or initAnalog_4_20()
+	 *
+	 * @param use_alert_pin true to use the ALERT pin of the slot, false to poll the config register
+	 * @return true if the selected mode is active
+	 * @return false if the slot has no ALERT pin or the ALERT pin is used by the acquisition or window monitoring
+	 *
+	 * @par Usage
+	 * @code
+	 * bool has_rak13015 = rak_in.initRAK13015(SGM58031_FS_4_096, 9600);
+	 * if (has_rak13015)
+	 * {
+	 * 	rak_in.useAlertReady(true);
+	 * }
+	 * @endcode
+	 */
+	bool useAlertReady(bool use_alert_pin);
+
+	/**
+	 * @brief Set the ADC data rate of a channel.
+	 * 		Used by all single-shot reads of the channel (read4_20ma(), readAnalog(), readAll(), startRead()).
+	 * 		The wait for the conversion result is derived from the data rate, high data rates finish in 1 to 2 ms,
+	 * 		low data rates reduce the noise but take up to 180 ms.
+	 * 		Selects a rate of the 6.25 ... 800 SPS table, use setSampleRate() for the full range
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param data_rate ADC data rate SGM58031_DR_6_25 ... SGM58031_DR_800
+	 * @return true if the data rate was set
+	 * @return false if the channel is invalid
+	 *
+	 * @par Usage
+	 * @code
+	 * // Fast 4-20mA loop, low noise voltage input
+	 * rak_in.setDataRate(RAK13015_CH_4_20_0, SGM58031_DR_800);
+	 * rak_in.setDataRate(RAK13015_CH_ANA_0, SGM58031_DR_12_5);
+	 * @endcode
+	 */
+	bool setDataRate(uint8_t channel, uint16_t data_rate);
+
+	/**
+	 * @brief Get the ADC data rate of a channel
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @return uint16_t data rate SGM58031_DR_6_25 ... SGM58031_DR_800, 0xFFFF if the channel is invalid
+	 */
+	uint16_t getDataRate(uint8_t channel);
+
+	/**
+	 * @brief Set the sample rate of a channel, full range of the ADC.
+	 * 		Rates of the 7.5 ... 960 SPS table set the Config1 DR_SEL bit of the ADC before each conversion of the channel,
+	 * 		channels of the same ADC can use different tables. The table of the channel is used by startAcquisition()
+	 * 		and setAlertWindow() as well.
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param rate Sample rate code SGM58031_SPS_6_25 ... SGM58031_SPS_960
+	 * @return true if the sample rate was set
+	 * @return false if the channel or the rate code is invalid
+	 *
+	 * @par Usage
+	 * @code
+	 * // Waveform capture at the highest rate of the ADC
+	 * rak_in.setSampleRate(RAK13015_CH_4_20_0, SGM58031_SPS_960);
+	 * Serial.printf("%.1f SPS\r\n", RAK_ADC_SGM58031::getSampleRate(rak_in.getSampleRate(RAK13015_CH_4_20_0)));
+	 * @endcode
+	 */
+	bool setSampleRate(uint8_t channel, uint8_t rate);
+
+	/**
+	 * @brief Get the sample rate code of a channel
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @return uint8_t sample rate code SGM58031_SPS_6_25 ... SGM58031_SPS_960, 0xFF if the channel is invalid
+	 */
+	uint8_t getSampleRate(uint8_t channel);
+
+	/**
+	 * @brief Set a digital filter for a channel.
+	 * 		All results of the channel (single-shot reads, readAll(), acquisition samples) pass through the filter,
+	 * 		one filtered value is returned per ADC sample.
+	 * 		read4_20ma() and readAnalog() fill an empty filter window with back-to-back conversions,
+	 * 		so the first result is already filtered. Use a high data rate to keep this short.
+	 * 		The median filter inserts each sample into a sorted window, its cost per sample is O(depth)
+	 * 		and grows with the depth up to RAK13015_FILTER_DEPTH.
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param type RAK13015_FILTER_NONE, RAK13015_FILTER_BOXCAR (moving average), RAK13015_FILTER_MEDIAN (spike rejection)
+	 * 		or RAK13015_FILTER_IIR (first-order low pass)
+	 * @param depth Window size in samples, for RAK13015_FILTER_IIR the time constant (rounded down to a power of 2),
+	 * 		limited to 1 ... RAK13015_FILTER_DEPTH
+	 * @return true if the filter was set
+	 * @return false if the channel or type is invalid
+	 *
+	 * @par Usage
+	 * @code
+	 * // Noisy 4-20mA loop, average 16 samples at 800 SPS
+	 * rak_in.setDataRate(RAK13015_CH_4_20_0, SGM58031_DR_800);
+	 * rak_in.setFilter(RAK13015_CH_4_20_0, RAK13015_FILTER_BOXCAR, 16);
+	 * Serial.printf("4-20mA CH0 : %.3f mA\r\n", rak_in.read4_20ma(I_4_20_CH_0));
+	 * @endcode
+	 */
+	bool setFilter(uint8_t channel, uint8_t type, uint8_t depth);
+
+	/**
+	 * @brief Drop the filter history of a channel, e.g. after a sensor was changed
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 */
+	void resetFilter(uint8_t channel);
+
+	/**
+	 * @brief Enable auto-ranging of the ADC full scale range of a channel.
+	 * 		The recent magnitude of the channel is tracked, after each reading the smallest range with
+	 * 		RAK13015_RANGE_HEADROOM % headroom is selected for the next reading. A reading that saturates is
+	 * 		measured again in the next larger range, a normal reading needs only one conversion.
+	 * 		Applies to single-shot reads (read4_20ma(), readAnalog(), readAll(), startRead()),
+	 * 		acquisition and window monitoring keep the range of the channel when they are started.
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param enable true to enable auto-ranging, false to keep the current range
+	 * @return true if the mode was set
+	 * @return false if the channel is invalid
+	 *
+	 * @par Usage
+	 * @code
+	 * rak_in.setAutoRange(RAK13015_CH_ANA_0, true);
+	 * float voltage = rak_in.readAnalog(ANA_CH_0);
+	 * Serial.printf("Analog CH0 : %.4f V, range %.3f V\r\n", voltage, rak_in.getRange(RAK13015_CH_ANA_0));
+	 * @endcode
+	 */
+	bool setAutoRange(uint8_t channel, bool enable);
+
+	/**
+	 * @brief Set the ADC full scale range of a channel, disables auto-ranging of the channel
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param full_scale Full scale range SGM58031_FS_6_144 SGM58031_FS_4_096 SGM58031_FS_2_048 SGM58031_FS_1_024 SGM58031_FS_0_512 SGM58031_FS_0_256
+	 * @return true if the range was set
+	 * @return false if the channel is invalid
+	 */
+	bool setRange(uint8_t channel, float full_scale);
+
+	/**
+	 * @brief Get the ADC full scale range used for the last reading of a channel
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @return float full scale range in volt, 0.0 if the channel is invalid
+	 */
+	float getRange(uint8_t channel);
+
+	/**
+	 * @brief Convert a current or voltage of a channel to raw counts in the current range of the channel.
+	 * 		E.g. for thresholds that are compared with acquisition samples
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param value Current in mA (4-20mA channels) or voltage in V (analog channels)
+	 * @return int16_t raw counts, limited to -32768 ... 32767
+	 *
+	 * @par Usage
+	 * @code
+	 * int16_t limit = rak_in.toRaw(RAK13015_CH_4_20_0, 12.0);
+	 * @endcode
+	 */
+	int16_t toRaw(uint8_t channel, float value);
+
+	/**
+	 * @brief Convert raw counts of a channel to uA (4-20mA channels) or uV (analog channels) without floating point.
+	 * 		Uses the current range of the channel, e.g. for acquisition samples or ADC ring buffer samples.
+	 * 		The scale factor of each channel type and range is a precomputed constant, the conversion is
+	 * 		(raw * mult + 2^31) >> 32 with a 64 bit product. The result equals the exact value rounded half up
+	 * 		(towards +infinity) for every raw value and is identical on all platforms.
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param raw Raw ADC counts
+	 * @return int32_t current in uA or voltage in uV, 0 if the channel is invalid
+	 *
+	 * @par Usage
+	 * @code
+	 * rak13015_sample_t samples[32];
+	 * uint16_t num_samples = rak_in.readAcquisition(samples, 32);
+	 * for (uint16_t idx = 0; idx < num_samples; idx++)
+	 * {
+	 * 	Serial.printf("%ld uA\r\n", rak_in.toMicro(samples[idx].channel, samples[idx].raw));
+	 * }
+	 * @endcode
+	 */
+	int32_t toMicro(uint8_t channel, int16_t raw);
+
+	/**
+	 * @brief Convert a buffer of raw counts of a channel to uA (4-20mA channels) or uV (analog channels).
+	 * 		Same conversion as toMicro(channel, raw), the scale factor is looked up once for the whole buffer
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param raw Buffer with raw ADC counts
+	 * @param micro Buffer for the results, at least count entries
+	 * @param count Number of samples
+	 * @return true if the buffer was converted
+	 * @return false if the channel is invalid
+	 */
+	bool toMicro(uint8_t channel, const int16_t *raw, int32_t *micro, uint16_t count);
+
+	/**
+	 * @brief Get the last reading of a channel in uA (4-20mA channels) or uV (analog channels).
+	 * 		Integer conversion of the raw counts in the range used for the reading, see toMicro()
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @return int32_t current in uA or voltage in uV, 0 if the channel is invalid
+	 *
+	 * @par Usage
+	 * @code
+	 * if (rak_in.read4_20ma(I_4_20_CH_0) != -50.0)
+	 * {
+	 * 	int32_t current_ua = rak_in.getMicro(RAK13015_CH_4_20_0);
+	 * }
+	 * @endcode
+	 */
+	int32_t getMicro(uint8_t channel);
+
+	/**
+	 * @brief Set the calibration of a channel, e.g. to correct shunt and divider resistor tolerances.
+	 * 		The measured value in uA or uV is corrected to gain * measured + offset. If a table is given,
+	 * 		the result is then mapped piecewise linear from the measured points to the actual points,
+	 * 		outside of the table the first or last segment is extended.
+	 * 		All coefficients are converted to integers here, the correction of a sample costs two multiplications.
+	 * 		The calibration applies to all results of the channel (float values, toMicro(), getMicro(), snapshots).
+	 * 		Float values of a calibrated channel have a resolution of 1 uA or 1 uV.
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param offset Offset in uA (4-20mA channels) or uV (analog channels)
+	 * @param gain Gain factor, 0.0 < gain < 128.0
+	 * @param measured Optional table of measured values in uA or uV, strictly ascending
+	 * @param actual Optional table of the actual values for the measured values, the slope of each segment must be within -128 ... 128
+	 * @param points Number of table points, 0 or 2 ... RAK13015_CAL_POINTS
+	 * @return true if the calibration was set
+	 * @return false if a parameter is invalid, the previous calibration is kept
+	 *
+	 * @par Usage
+	 * @code
+	 * // Shunt is 0.4% low, loop reads 12 uA high at 4 mA
+	 * rak_in.setCalibration(RAK13015_CH_4_20_0, -12, 1.004);
+	 * // Three point correction of the analog input
+	 * int32_t measured[3] = {0, 12000000, 24000000};
+	 * int32_t actual[3] = {0, 12050000, 24020000};
+	 * rak_in.setCalibration(RAK13015_CH_ANA_0, 0, 1.0, measured, actual, 3);
+	 * @endcode
+	 */
+	bool setCalibration(uint8_t channel, int32_t offset, float gain, const int32_t *measured = NULL, const int32_t *actual = NULL, uint8_t points = 0);
+
+	/**
+	 * @brief Remove the calibration of a channel
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 */
+	void clearCalibration(uint8_t channel);
+
+	/**
+	 * @brief Serialize the calibration of all channels into a compact binary blob, e.g. to store it in flash.
+	 * 		The blob holds the integer coefficients and ends with a Fletcher-16 checksum
+	 *
+	 * @param blob Buffer for the blob, NULL to get the required size
+	 * @param size Size of the buffer, RAK13015_CAL_BLOB_SIZE is enough for any calibration
+	 * @return uint16_t number of bytes written (or required if blob is NULL), 0 if the buffer is too small
+	 *
+	 * @par Usage
+	 * @code
+	 * uint8_t blob[RAK13015_CAL_BLOB_SIZE];
+	 * uint16_t blob_size = rak_in.saveCalibration(blob, sizeof(blob));
+	 * // write blob_size bytes to flash
+	 * @endcode
+	 */
+	uint16_t saveCalibration(uint8_t *blob, uint16_t size);
+
+	/**
+	 * @brief Load the calibration of all channels from a blob created by saveCalibration().
+	 * 		The blob is checked completely before it is applied, channels not in the blob are uncalibrated
+	 *
+	 * @param blob Blob data
+	 * @param size Size of the blob
+	 * @return true if the calibration was loaded
+	 * @return false if the blob is invalid, holds a calibration rejected by setCalibration() or the checksum does not match, the current calibration is kept
+	 *
+	 * @par Usage
+	 * @code
+	 * // blob and blob_size read from flash
+	 * if (!rak_in.loadCalibration(blob, blob_size))
+	 * {
+	 * 	Serial.println("No valid calibration");
+	 * }
+	 * @endcode
+	 */
+	bool loadCalibration(const uint8_t *blob, uint16_t size);
+
+	/**
+	 * @brief Get the statistics of a channel since the last reset, e.g. for one summary per uplink interval.
+	 * 		Every reading of the channel is accumulated with the Welford algorithm, O(1) per reading:
+	 * 		single reads, readAll(), non-blocking reads and the samples of the interrupt driven acquisition.
+	 * 		The raw samples of captureBurst() bypass the filter and are not accumulated.
+	 * 		Taking the snapshot and resetting is done with interrupts disabled, no reading is lost or counted twice.
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1
+	 * @param stats Receives count, min, max, mean, variance and standard deviation
+	 * @param reset true to start a new interval after the snapshot
+	 * @return true if the channel has readings
+	 * @return false if the channel is invalid or has no readings since the last reset
+	 *
+	 * @par Usage
+	 * @code
+	 * rak13015_stats_t stats;
+	 * if (rak_in.getStatistics(RAK13015_CH_4_20_0, stats))
+	 * {
+	 * 	Serial.printf("%ld readings, min %.2f max %.2f mean %.2f stddev %.3f mA\r\n", stats.count, stats.min, stats.max, stats.mean, stats.stddev);
+	 * }
+	 * @endcode
+	 */
+	bool getStatistics(uint8_t channel, rak13015_stats_t &stats, bool reset = true);
+
+	/**
+	 * @brief Reset the statistics of a channel
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1, RAK13015_NUM_CH for all channels
+	 */
+	void resetStatistics(uint8_t channel = RAK13015_NUM_CH);
+
 	/**
 	 * @brief Initialize the RS485 interface as simple Modbus RTU master device
 	 *
@@ -227,6 +962,8 @@ public:
 
 	/**
 	 * @brief Request data from slave device on Modbus
+	 * 		Blocks until the response arrives. Transactions submitted before with submitModbus() are finished
+	 * 		first and their callbacks are called from here. Not allowed inside a submitModbus() callback.
 	 *
 	 * @param slave_addr Slave address
 	 * @param address Register/Coil start address for reading
@@ -234,7 +971,7 @@ public:
 	 * @param coils_regs Buffer to save returned data
 	 * @param timeout Timeout in ms to wait for failed return
 	 * @return true Data was received
-	 * @return false No Data was received
+	 * @return false No Data was received or called from a submitModbus() callback
 	 *
 	 * @par Usage
 	 * @code
@@ -263,6 +1000,8 @@ public:
 
 	/**
 	 * @brief Send data over Modbus to a slave device
+	 * 		Blocks until the response arrives. Transactions submitted before with submitModbus() are finished
+	 * 		first and their callbacks are called from here. Not allowed inside a submitModbus() callback.
 	 *
 	 * @param slave_addr Slave address
 	 * @param address Register/Coil start address for writing
@@ -270,7 +1009,7 @@ public:
 	 * @param coils_regs Buffer with data to write
 	 * @param timeout Timeout in ms to wait for failed response
 	 * @return true Data was sent
-	 * @return false Failure to send data
+	 * @return false Failure to send data or called from a submitModbus() callback
 	 * @code
 	 * bool has_rak13015 = rak_in.initRAK13015(SGM58031_FS_4_096, 9600);
 	 * if (has_rak13015)
@@ -302,21 +1041,200 @@ public:
 	 */
 	bool writeModBus(uint8_t slave_addr, uint16_t address, uint16_t num_coils, uint16_t *coils_regs, time_t timeout);
 
+	/**
+	 * @brief Submit a Modbus transaction without waiting for the response.
+	 * 		Transactions are sent one after the other in the order they were submitted,
+	 * 		serviceModbus() sends the queries and receives the responses.
+	 * 		The status field of the transaction can be used as handle instead of a callback
+	 *
+	 * @param transaction Transaction, slave, function, address, count, regs and timeout must be set
+	 * @param callback Called from serviceModbus() when the transaction is finished, can be NULL.
+	 * 		It may submit the next transaction, requestModBus() and writeModBus() return false inside the callback
+	 * @return true if the transaction was queued
+	 * @return false if the transaction is invalid, already queued or the queue is full
+	 *
+	 * @par Usage
+	 * @code
+	 * uint16_t coils_n_regs[5];
+	 * rak13015_modbus_t read_regs = {1, MB_FC_READ_REGISTERS, 0, 5, coils_n_regs, 1000};
+	 *
+	 * void modbus_done(rak13015_modbus_t *transaction)
+	 * {
+	 * 	if (transaction->status == RAK13015_MB_DONE)
+	 * 	{
+	 * 		Serial.printf("Register 0: %04X\r\n", transaction->regs[0]);
+	 * 	}
+	 * }
+	 *
+	 * rak_in.submitModbus(&read_regs, modbus_done);
+	 * // in loop(), ADC reads and radio work continue while the slave answers
+	 * rak_in.serviceModbus();
+	 * @endcode
+	 */
+	bool submitModbus(rak13015_modbus_t *transaction, void (*callback)(rak13015_modbus_t *transaction) = NULL);
+
+	/**
+	 * @brief Advance the Modbus transactions, call frequently from loop()
+	 * 		Checks the response of the running transaction and sends the next query when it is finished.
+	 * 		Callbacks of finished transactions are called from here
+	 *
+	 * @return uint8_t number of transactions not yet finished
+	 */
+	uint8_t serviceModbus(void);
+
 	/** UART to be used for Modbus RTU master */
-	Stream &_rs485 = Serial1;
+	Stream &_rs485;
 
 private:
+	/** Compiled in the library, layout is the object size seen by the sketch */
+	RAK13015(uint8_t slot, uint8_t base_board, TwoWire &wire, size_t layout);
+	/** false if sketch and library were compiled with a different MAX_BUFFER */
+	bool _layout_ok = true;
+	bool checkSetup(void);
+
 	uint8_t _used_slot = SLOT_D;
 	uint8_t _used_base = RAK19007;
 	uint8_t _used_serial = 0;
-	uint8_t _alert_pin = ALERT_D;
-	uint8_t _tcon_pin = TCON_D;
-
-	float _current_ch0;
-	float _current_ch1;
-	float _current_ch2;
-	float _voltage_ch0;
-	float _voltage_ch1;
+	int8_t _alert_pin = ALERT_D;
+	int8_t _tcon_pin = TCON_D;
+
+	/** ADCs and Modbus RTU master of this module */
+	RAK_ADC_SGM58031 _ad0;
+	RAK_ADC_SGM58031 _ad1;
+	Modbus _master;
+	static Stream &slotSerial(uint8_t slot, uint8_t base_board);
+
+	/** States of a non-blocking ADC read */
+	enum
+	{
+		READ_IDLE = 0,
+		READ_CONVERTING,
+		READ_READY,
+		READ_TIMEOUT
+	};
+
+	/** Non-blocking read state of one ADC */
+	typedef struct
+	{
+		uint8_t state;	  //!< READ_IDLE ... READ_TIMEOUT
+		uint8_t channel;  //!< channel index of the running read
+		uint32_t start;	  //!< micros() when the conversion was started
+		float value;	  //!< result, read when the conversion is done
+	} adc_read_t;
+
+	adc_read_t _adc_read[2] = {{READ_IDLE, RAK13015_NUM_CH, 0, 0.0}, {READ_IDLE, RAK13015_NUM_CH, 0, 0.0}};
+
+	/** Index of the ADC that handles a channel, ANA_CH_1 is on the second ADC */
+	uint8_t adcIndex(uint8_t channel) { return channel == RAK13015_CH_ANA_1 ? 1 : 0; }
+	RAK_ADC_SGM58031 &adcOf(uint8_t channel);
+	RAK_ADC_SGM58031 &selectChannel(uint8_t channel);
+	bool waitRead(uint8_t channel);
+	float readChannel(uint8_t channel);
+	float toEngineering(uint8_t channel, float voltage);
+	bool storeResult(rak13015_snapshot_t &snapshot, uint8_t channel, bool ready);
+	bool beginScan(rak13015_snapshot_t &snapshot);
+	void stepScan(rak13015_snapshot_t &snapshot, uint8_t step);
+	bool endScan(rak13015_snapshot_t &snapshot);
+	bool _scanning = false;		 //!< readAll() sequence started
+	uint8_t _scan_remeasure = 0; //!< saturated channels of the running sequence, bit n is channel index n
+	int16_t readRaw(uint8_t channel);
+	float toVoltage(uint8_t channel, int16_t raw);
+	bool convertSample(uint8_t channel, int16_t &raw, float &value);
+	void changeRange(uint8_t channel, uint16_t pga);
+	int64_t microScale(uint8_t channel, uint16_t pga);
+	float toValue(uint8_t channel, int16_t raw);
+	int32_t calibrate(uint8_t channel, int32_t micro);
+	bool setCalibrationTable(uint8_t channel, int32_t offset, int32_t gain, const int32_t *measured, const int32_t *actual, uint8_t points);
+
+	/** Calibration of one channel, integer coefficients */
+	typedef struct
+	{
+		int32_t offset;							 //!< offset in uA or uV
+		int32_t gain;							 //!< gain * 2^24
+		uint8_t points;							 //!< number of table points, 0 if no table
+		int32_t measured[RAK13015_CAL_POINTS];	 //!< table input in uA or uV, ascending
+		int32_t actual[RAK13015_CAL_POINTS];	 //!< table output in uA or uV
+		int32_t slope[RAK13015_CAL_POINTS - 1]; //!< slope of each segment * 2^24
+	} cal_t;
+
+	cal_t _cal[RAK13015_NUM_CH];
+	uint8_t _cal_mask = 0; //!< calibrated channels, bit n is channel index n
+
+	/** ADCs verified by their chip ID since the last cold init */
+	bool _verified = false;
+	rak13015_init_stats_t _init_stats = {0, 0, 0, 0, 0, {0, 0}};
+
+	/** useAlertReady() setting */
+	bool _alert_ready = false;
+
+	/** ALERT interrupt owners, one entry per module with an attached ALERT pin */
+	template <uint8_t N>
+	static void alertISR(void)
+	{
+		if (_isr_owner[N] != NULL)
+		{
+			_isr_owner[N]->onAlert();
+		}
+	}
+	static RAK13015 *_isr_owner[RAK13015_MAX_MODULES];
+	static void (*const _isr_entry[RAK13015_MAX_MODULES])(void);
+	uint8_t _isr_slot = RAK13015_MAX_MODULES; //!< entry in _isr_owner, RAK13015_MAX_MODULES if none
+	bool claimAlert(void);
+	void releaseAlert(void);
+
+	/** Interrupt driven acquisition */
+	void onAlert(void);
+	bool isAcquiring(uint8_t channel);
+	uint8_t _acq_channel = RAK13015_NUM_CH;	  //!< channel of the acquisition, RAK13015_NUM_CH if not running
+	volatile uint16_t _acq_edges = 0;		  //!< ALERT/RDY edges, written by the ISR only
+	volatile uint32_t _acq_edge_time = 0;	  //!< micros() of the last edge, written by the ISR only
+	uint16_t _acq_handled = 0;				  //!< edges handled by serviceAcquisition()
+	uint16_t _acq_missed = 0;				  //!< conversions overwritten before they were read
+	RAK_ADC_SGM58031 *volatile _burst_adc = NULL; //!< ADC of a running captureBurst(), its ready edges are counted in onAlert()
+	RAK13015_Queue<rak13015_sample_t, RAK13015_QUEUE_SIZE> _acq_queue;
+
+	/** Window comparator monitoring */
+	uint8_t _window_channel[2] = {RAK13015_NUM_CH, RAK13015_NUM_CH}; //!< monitored channel per ADC, RAK13015_NUM_CH if none
+	int16_t _window_low[2];											 //!< lower limit in raw counts per ADC
+	int16_t _window_high[2];										 //!< upper limit in raw counts per ADC
+	void (*_window_callback[2])(void) = {NULL, NULL};				 //!< called from the ALERT interrupt, per ADC
+
+	/** ADC config of each channel, setDataRate() changes the DR bits */
+	uint16_t _channel_config[RAK13015_NUM_CH] = {I_4_20_CH_0, I_4_20_CH_1, I_4_20_CH_2, ANA_CH_0, ANA_CH_1};
+	/** Channels using the Config1 DR_SEL data rate table, bit n is channel index n */
+	uint8_t _channel_dr_sel = 0;
+
+	/** Filter of each channel */
+	RAK13015_Filter<RAK13015_FILTER_DEPTH> _filter[RAK13015_NUM_CH];
+
+	/** Running statistics of one channel */
+	typedef struct
+	{
+		uint32_t count; //!< number of readings
+		float min;		//!< smallest reading
+		float max;		//!< largest reading
+		float mean;		//!< running mean
+		float m2;		//!< sum of squared differences from the mean
+	} stats_t;
+
+	stats_t _stats[RAK13015_NUM_CH] = {};
+	void accumulate(uint8_t channel, float value);
+
+	/** Auto-ranging */
+	uint8_t _auto_range = 0;			   //!< channels with auto-ranging, bit n is channel index n
+	float _range_peak[RAK13015_NUM_CH];	   //!< recent magnitude in volt
+	uint16_t _range_used[RAK13015_NUM_CH]; //!< PGA bits of the last reading
+	int16_t _raw_used[RAK13015_NUM_CH];	   //!< raw counts of the last reading
+
+	/** Last measured value of each channel */
+	float _values[RAK13015_NUM_CH];
+
+	/** Asynchronous Modbus transactions */
+	rak13015_modbus_t *_mb_active = NULL; //!< transaction waiting for its response
+	uint8_t _mb_callbacks = 0;			  //!< completion callbacks running, blocking requests are refused inside
+	RAK13015_Queue<rak13015_modbus_t *, RAK13015_MODBUS_QUEUE> _mb_queue;
+	void finishModbus(uint8_t status, int16_t result);
+	bool waitModbus(rak13015_modbus_t &transaction);
 
 	uint8_t _deviceID = 0;
 	uint8_t _bidx = 0;
@@ -0,0 +1,236 @@
+/**
+ * @file RAK13015_Deadband.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Report-by-exception deadband for channel readings and Modbus registers
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _RAK13015_DEADBAND_H_
+#define _RAK13015_DEADBAND_H_
+
+#include <Arduino.h>
+#include "RAK13015.h"
+
+/**
+ * @brief Report-by-exception layer over up to 32 values, e.g. the 5 channels and some Modbus registers.
+ * 		A value is in the changed set if it moved more than its deadband since it was last reported,
+ * 		or if it was not reported for longer than its heartbeat. Values that were never reported are always changed.
+ * 		The deadband is the larger of the absolute deadband and the relative deadband times the last reported value.
+ * 		The changed set is a bitmap, bit n is value index n. Only the values that were actually sent are marked
+ * 		as reported, values of a failed transmission stay in the changed set.
+ *
+ * @tparam SIZE Number of values, 1 ... 32
+ *
+ * @par Usage
+ * @code
+ * // Index 0 ... 4 are the channels, index 5 ... 6 two Modbus registers
+ * RAK13015_Deadband<7> deadband;
+ * // 0.1 mA or 1 %, report at least every 15 minutes
+ * for (uint8_t idx = RAK13015_CH_4_20_0; idx <= RAK13015_CH_4_20_2; idx++)
+ * {
+ * 	deadband.setup(idx, 0.1, 0.01, 15 * 60 * 1000);
+ * }
+ * // 0.05 V, report at least every 15 minutes
+ * deadband.setup(RAK13015_CH_ANA_0, 0.05, 0.0, 15 * 60 * 1000);
+ * deadband.setup(RAK13015_CH_ANA_1, 0.05, 0.0, 15 * 60 * 1000);
+ * // Any change of the registers, report at least every hour
+ * deadband.setup(5, 0.0, 0.0, 60 * 60 * 1000);
+ * deadband.setup(6, 0.0, 0.0, 60 * 60 * 1000);
+ *
+ * rak13015_snapshot_t snapshot;
+ * uint16_t regs[2];
+ * rak_in.readAll(snapshot);
+ * deadband.update(snapshot);
+ * if (rak_in.requestModBus(1, 0, 2, regs, 5000))
+ * {
+ * 	deadband.update(regs, 2, 5);
+ * }
+ * uint32_t changed = deadband.changed();
+ * for (uint8_t idx = 0; idx < 7; idx++)
+ * {
+ * 	if (changed & (1 << idx))
+ * 	{
+ * 		// add deadband.value(idx) to the payload
+ * 	}
+ * }
+ * if (send_payload())
+ * {
+ * 	deadband.reported(changed);
+ * }
+ * @endcode
+ */
+template <uint8_t SIZE>
+class RAK13015_Deadband
+{
+	static_assert((SIZE >= 1) && (SIZE <= 32), "Deadband supports 1 ... 32 values");
+
+public:
+	/**
+	 * @brief Set the deadband of a value, the value is reported with the next update
+	 *
+	 * @param index Value index
+	 * @param absolute Absolute deadband in the unit of the value, 0 for none
+	 * @param relative Relative deadband as a fraction of the last reported value, e.g. 0.01 for 1 %, 0 for none
+	 * @param heartbeat Maximum time in ms without a report, 0 for none
+	 * @return true if the index is valid
+	 */
+	bool setup(uint8_t index, float absolute, float relative, uint32_t heartbeat)
+	{
+		if (index >= SIZE)
+		{
+			return false;
+		}
+		_absolute[index] = absolute < 0 ? -absolute : absolute;
+		_relative[index] = relative < 0 ? -relative : relative;
+		_heartbeat[index] = heartbeat;
+		_reported_mask &= ~(1UL << index);
+		return true;
+	}
+
+	/**
+	 * @brief Forget all reports, every value is reported with the next update
+	 */
+	void reset(void)
+	{
+		_reported_mask = 0;
+		_valid = 0;
+		_changed = 0;
+	}
+
+	/**
+	 * @brief Update a value
+	 *
+	 * @param index Value index
+	 * @param value Current value
+	 * @param now Current time in ms
+	 * @return true if the value is in the changed set
+	 */
+	bool update(uint8_t index, float value, uint32_t now = millis())
+	{
+		if (index >= SIZE)
+		{
+			return false;
+		}
+		uint32_t bit = 1UL << index;
+		_value[index] = value;
+		_valid |= bit;
+		if (isChanged(index, value, now))
+		{
+			_changed |= bit;
+		}
+		else
+		{
+			// The value moved back into the deadband
+			_changed &= ~bit;
+		}
+		return (_changed & bit) != 0;
+	}
+
+	/**
+	 * @brief Update the channel values of a snapshot, channels that were not read are skipped
+	 *
+	 * @param snapshot Snapshot of readAll()
+	 * @param first Value index of RAK13015_CH_4_20_0, the channels use first ... first + 4
+	 * @param now Current time in ms
+	 * @return uint32_t changed set
+	 */
+	uint32_t update(const rak13015_snapshot_t &snapshot, uint8_t first = 0, uint32_t now = millis())
+	{
+		for (uint8_t channel = 0; channel < RAK13015_NUM_CH; channel++)
+		{
+			if (snapshot.valid & (1 << channel))
+			{
+				update(first + channel, snapshot.values[channel], now);
+			}
+		}
+		return _changed;
+	}
+
+	/**
+	 * @brief Update Modbus register values
+	 *
+	 * @param regs Registers of requestModBus()
+	 * @param count Number of registers
+	 * @param first Value index of the first register
+	 * @param now Current time in ms
+	 * @return uint32_t changed set
+	 */
+	uint32_t update(const uint16_t *regs, uint8_t count, uint8_t first, uint32_t now = millis())
+	{
+		for (uint8_t idx = 0; idx < count; idx++)
+		{
+			update(first + idx, regs[idx], now);
+		}
+		return _changed;
+	}
+
+	/**
+	 * @brief Values that changed enough since they were last reported
+	 *
+	 * @return uint32_t changed set, bit n is value index n
+	 */
+	uint32_t changed(void) { return _changed; }
+
+	/**
+	 * @brief Current value of an index
+	 *
+	 * @param index Value index
+	 * @return float last value given to update(), 0 if none
+	 */
+	float value(uint8_t index) { return ((index < SIZE) && (_valid & (1UL << index))) ? _value[index] : 0.0; }
+
+	/**
+	 * @brief Mark values as reported after they were sent
+	 *
+	 * @param mask Values that were sent, usually the changed set used for the payload
+	 * @param now Current time in ms
+	 */
+	void reported(uint32_t mask, uint32_t now = millis())
+	{
+		mask &= _valid;
+		for (uint8_t index = 0; index < SIZE; index++)
+		{
+			if (mask & (1UL << index))
+			{
+				_last[index] = _value[index];
+				_last_time[index] = now;
+			}
+		}
+		_reported_mask |= mask;
+		_changed &= ~mask;
+	}
+
+private:
+	bool isChanged(uint8_t index, float value, uint32_t now)
+	{
+		if (!(_reported_mask & (1UL << index)))
+		{
+			return true;
+		}
+		if ((_heartbeat[index] != 0) && ((now - _last_time[index]) >= _heartbeat[index]))
+		{
+			return true;
+		}
+		float delta = value - _last[index];
+		delta = delta < 0 ? -delta : delta;
+		float last = _last[index] < 0 ? -_last[index] : _last[index];
+		float band = _relative[index] * last;
+		band = band > _absolute[index] ? band : _absolute[index];
+		return delta > band;
+	}
+
+	uint32_t _changed = 0;		  //!< changed set
+	uint32_t _valid = 0;		  //!< values given to update()
+	uint32_t _reported_mask = 0;  //!< values reported at least once with the current setup
+	float _value[SIZE];			  //!< current values
+	float _last[SIZE];			  //!< last reported values
+	uint32_t _last_time[SIZE];	  //!< millis() of the last report
+	float _absolute[SIZE] = {};	  //!< absolute deadband
+	float _relative[SIZE] = {};	  //!< relative deadband
+	uint32_t _heartbeat[SIZE] = {}; //!< maximum silence in ms
+};
+
+#endif // _RAK13015_DEADBAND_H_
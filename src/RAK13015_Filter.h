@@ -0,0 +1,219 @@
+/**
+ * @file RAK13015_Filter.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Digital filters for the raw ADC samples
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _RAK13015_FILTER_H_
+#define _RAK13015_FILTER_H_
+
+#include <Arduino.h>
+
+// Filter types
+#define RAK13015_FILTER_NONE 0
+#define RAK13015_FILTER_BOXCAR 1
+#define RAK13015_FILTER_MEDIAN 2
+#define RAK13015_FILTER_IIR 3
+
+/**
+ * @brief Sliding filter over raw ADC samples, one filtered value per input sample.
+ * 		All state is statically allocated for the maximum depth.
+ * 		- Boxcar: mean of the last depth samples, running sum, O(1) per sample
+ * 		- Median: median of the last depth samples for spike rejection, sorted window, O(depth) per sample
+ * 		- IIR: first-order low pass y += (x - y) / 2^k with 2^k the largest power of 2 <= depth, O(1) per sample
+ *
+ * @tparam DEPTH Maximum window size
+ */
+template <uint8_t DEPTH>
+class RAK13015_Filter
+{
+	static_assert((DEPTH >= 1) && (DEPTH <= 128), "Filter depth must be 1 ... 128");
+
+public:
+	/**
+	 * @brief Select the filter type and depth, the filter is reset
+	 *
+	 * @param type RAK13015_FILTER_NONE ... RAK13015_FILTER_IIR
+	 * @param depth Window size or IIR time constant in samples, limited to 1 ... DEPTH
+	 */
+	void setup(uint8_t type, uint8_t depth)
+	{
+		_type = type;
+		_depth = depth < 1 ? 1 : (depth > DEPTH ? DEPTH : depth);
+		_shift = 0;
+		while ((2 << _shift) <= _depth)
+		{
+			_shift++;
+		}
+		reset();
+	}
+
+	/**
+	 * @brief Drop the filter history, the next sample starts a new window
+	 */
+	void reset(void)
+	{
+		_count = 0;
+		_head = 0;
+		_sum = 0;
+	}
+
+	/**
+	 * @brief Scale the filter history, e.g. after the ADC range changed
+	 *
+	 * @param num Multiplier, e.g. the full scale of the old range
+	 * @param den Divider, e.g. the full scale of the new range
+	 */
+	void rescale(int32_t num, int32_t den)
+	{
+		if (_type == RAK13015_FILTER_NONE)
+		{
+			return;
+		}
+		if (_type == RAK13015_FILTER_IIR)
+		{
+			_sum = (int32_t)((int64_t)_sum * num / den);
+			return;
+		}
+		_sum = 0;
+		for (uint8_t idx = 0; idx < _count; idx++)
+		{
+			_window[idx] = scale(_window[idx], num, den);
+			// Sorting is kept, the scaling is monotonic
+			_sorted[idx] = scale(_sorted[idx], num, den);
+			_sum += _window[idx];
+		}
+	}
+
+	/**
+	 * @brief Filter type
+	 */
+	uint8_t type(void) { return _type; }
+
+	/**
+	 * @brief Check if the window is filled
+	 *
+	 * @return true if the output is based on a full window (IIR: after the first sample)
+	 */
+	bool isPrimed(void)
+	{
+		switch (_type)
+		{
+		case RAK13015_FILTER_BOXCAR:
+		case RAK13015_FILTER_MEDIAN:
+			return _count >= _depth;
+		default:
+			return _count != 0;
+		}
+	}
+
+	/**
+	 * @brief Add a sample and get the filtered value
+	 *
+	 * @param raw Raw ADC sample
+	 * @return int16_t filtered value, the sample itself for RAK13015_FILTER_NONE
+	 */
+	int16_t update(int16_t raw)
+	{
+		switch (_type)
+		{
+		case RAK13015_FILTER_BOXCAR:
+			return boxcar(raw);
+		case RAK13015_FILTER_MEDIAN:
+			return median(raw);
+		case RAK13015_FILTER_IIR:
+			return iir(raw);
+		default:
+			_count = 1;
+			return raw;
+		}
+	}
+
+private:
+	int16_t scale(int16_t value, int32_t num, int32_t den)
+	{
+		int32_t scaled = (int32_t)value * num / den;
+		return (int16_t)(scaled > 32767 ? 32767 : (scaled < -32768 ? -32768 : scaled));
+	}
+
+	int16_t boxcar(int16_t raw)
+	{
+		if (_count == _depth)
+		{
+			_sum -= _window[_head];
+		}
+		else
+		{
+			_count++;
+		}
+		_sum += raw;
+		_window[_head] = raw;
+		_head = (_head + 1) % _depth;
+		// Round half away from zero
+		int32_t half = _count / 2;
+		return (int16_t)(_sum >= 0 ? (_sum + half) / _count : (_sum - half) / _count);
+	}
+
+	int16_t median(int16_t raw)
+	{
+		uint8_t pos;
+		if (_count == _depth)
+		{
+			// Remove the oldest sample from the sorted window
+			int16_t oldest = _window[_head];
+			for (pos = 0; _sorted[pos] != oldest; pos++)
+			{
+			}
+			for (; pos < _count - 1; pos++)
+			{
+				_sorted[pos] = _sorted[pos + 1];
+			}
+			_count--;
+		}
+		_window[_head] = raw;
+		_head = (_head + 1) % _depth;
+		// Insert the new sample
+		for (pos = _count; (pos > 0) && (_sorted[pos - 1] > raw); pos--)
+		{
+			_sorted[pos] = _sorted[pos - 1];
+		}
+		_sorted[pos] = raw;
+		_count++;
+		if (_count & 1)
+		{
+			return _sorted[_count / 2];
+		}
+		return (int16_t)(((int32_t)_sorted[_count / 2 - 1] + _sorted[_count / 2]) / 2);
+	}
+
+	int16_t iir(int16_t raw)
+	{
+		// 8 fractional bits to keep small steps for long time constants
+		int32_t in = (int32_t)raw * 256;
+		if (_count == 0)
+		{
+			_sum = in;
+			_count = 1;
+		}
+		else
+		{
+			_sum += (in - _sum) >> _shift;
+		}
+		return (int16_t)((_sum + 128) >> 8);
+	}
+
+	uint8_t _type = RAK13015_FILTER_NONE;
+	uint8_t _depth = 1;
+	uint8_t _shift = 0;
+	uint8_t _count = 0;
+	uint8_t _head = 0;
+	int32_t _sum = 0;		//!< Boxcar running sum or IIR state
+	int16_t _window[DEPTH]; //!< Samples in arrival order
+	int16_t _sorted[DEPTH]; //!< Samples in ascending order, median only
+};
+
+#endif // _RAK13015_FILTER_H_
@@ -0,0 +1,100 @@
+/**
+ * @file RAK13015_Queue.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Lock-free single-producer / single-consumer queue
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _RAK13015_QUEUE_H_
+#define _RAK13015_QUEUE_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Lock-free queue for one producer (e.g. an ISR or worker task) and one consumer (e.g. the loop).
+ * 		The producer only writes the head index, the consumer only writes the tail index.
+ * 		One slot is kept free to tell a full queue from an empty one.
+ *
+ * @tparam T Item type
+ * @tparam SIZE Number of slots, must be a power of 2
+ */
+template <typename T, uint16_t SIZE>
+class RAK13015_Queue
+{
+	static_assert((SIZE >= 2) && ((SIZE & (SIZE - 1)) == 0), "Queue size must be a power of 2");
+
+public:
+	/**
+	 * @brief Add an item, producer side only
+	 *
+	 * @param item Item to add
+	 * @return true if the item was added
+	 * @return false if the queue is full, the item is dropped
+	 */
+	bool push(const T &item)
+	{
+		uint16_t head = _head;
+		uint16_t next = (head + 1) & (SIZE - 1);
+		if (next == _tail)
+		{
+			_dropped++;
+			return false;
+		}
+		_items[head] = item;
+		// Item must be written before it is published to the consumer
+		__sync_synchronize();
+		_head = next;
+		return true;
+	}
+
+	/**
+	 * @brief Remove the oldest item, consumer side only
+	 *
+	 * @param item Receives the item
+	 * @return true if an item was removed
+	 * @return false if the queue is empty
+	 */
+	bool pop(T &item)
+	{
+		uint16_t tail = _tail;
+		if (tail == _head)
+		{
+			return false;
+		}
+		item = _items[tail];
+		// Item must be read before the slot is released to the producer
+		__sync_synchronize();
+		_tail = (tail + 1) & (SIZE - 1);
+		return true;
+	}
+
+	/**
+	 * @brief Number of items in the queue
+	 */
+	uint16_t count(void) { return (_head - _tail) & (SIZE - 1); }
+
+	/**
+	 * @brief Number of items dropped because the queue was full
+	 */
+	uint16_t dropped(void) { return _dropped; }
+
+	/**
+	 * @brief Empty the queue, only while the producer is stopped
+	 */
+	void clear(void)
+	{
+		_tail = _head;
+		_dropped = 0;
+	}
+
+private:
+	T _items[SIZE];
+	volatile uint16_t _head = 0;
+	volatile uint16_t _tail = 0;
+	volatile uint16_t _dropped = 0;
+};
+
+#endif // _RAK13015_QUEUE_H_
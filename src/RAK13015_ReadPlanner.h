@@ -0,0 +1,303 @@
+/**
+ * @file RAK13015_ReadPlanner.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Coalescing of register reads into the fewest FC3/FC4 transactions
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _RAK13015_READPLANNER_H_
+#define _RAK13015_READPLANNER_H_
+
+#include <Arduino.h>
+#include "RAK13015.h"
+
+// Largest number of registers in a FC3/FC4 response that fits into the Modbus buffer
+#define RAK13015_PLAN_MAX_REGS (((MAX_BUFFER - 5) / 2) < 125 ? ((MAX_BUFFER - 5) / 2) : 125)
+
+/**
+ * @brief Register requested from a slave
+ */
+typedef struct
+{
+	uint8_t slave;	  //!< Slave address 1 ... 247
+	uint8_t function; //!< MB_FC_READ_REGISTERS or MB_FC_READ_INPUT_REGISTER
+	uint16_t address; //!< Register address
+	uint16_t *dest;	  //!< Receives the register value
+} rak13015_read_t;
+
+/**
+ * @brief Read planner, merges requested registers into the fewest contiguous reads per slave and function code.
+ * 		Two registers are read in one request if at most gap unrequested registers lie between them and the
+ * 		request stays within max_regs registers. The values of each response are copied to the destinations
+ * 		of the requested registers. Destinations of a failed request are not changed.
+ * 		A new plan or a restart is refused while a request of the current plan is still on the bus.
+ *
+ * @tparam BLOCKS Maximum number of requests of a plan
+ * @tparam REGS Size of the response buffer in registers, the largest request
+ *
+ * @par Usage
+ * @code
+ * uint16_t voltage[3], current[3], power, energy[2];
+ * // Registers 0 ... 2, 10 ... 12 and 20 ... 21 of meter 1
+ * rak13015_read_t reads[9] = {
+ * 	{1, MB_FC_READ_REGISTERS, 0, &voltage[0]}, {1, MB_FC_READ_REGISTERS, 1, &voltage[1]},
+ * 	{1, MB_FC_READ_REGISTERS, 2, &voltage[2]}, {1, MB_FC_READ_REGISTERS, 10, &current[0]},
+ * 	{1, MB_FC_READ_REGISTERS, 11, &current[1]}, {1, MB_FC_READ_REGISTERS, 12, &current[2]},
+ * 	{1, MB_FC_READ_REGISTERS, 13, &power}, {1, MB_FC_READ_REGISTERS, 20, &energy[0]},
+ * 	{1, MB_FC_READ_REGISTERS, 21, &energy[1]}};
+ * RAK13015_ReadPlanner<4> planner(rak_in);
+ * // Up to 8 unrequested registers are read to save a request, gives 1 request for registers 0 ... 21
+ * planner.plan(reads, 9, 8);
+ * if (planner.execute() == planner.requests())
+ * {
+ * 	Serial.println("All registers read");
+ * }
+ * @endcode
+ */
+template <uint8_t BLOCKS, uint8_t REGS = RAK13015_PLAN_MAX_REGS>
+class RAK13015_ReadPlanner
+{
+	static_assert((BLOCKS >= 1) && (REGS >= 1) && (REGS <= 125), "Planner needs 1 request and 1 ... 125 registers");
+
+public:
+	/**
+	 * @brief Read planner for the Modbus master of a module
+	 *
+	 * @param module Module with the RS485 interface, must be initialized with initRAK13015() or initModbus()
+	 */
+	RAK13015_ReadPlanner(RAK13015 &module) : _module(module) {}
+
+	/**
+	 * @brief Build the requests for a set of registers.
+	 * 		The reads are sorted in place by slave, function code and address
+	 *
+	 * @param reads Requested registers, must stay valid while the plan is used
+	 * @param count Number of requested registers
+	 * @param gap Maximum number of unrequested registers read to merge two requests
+	 * @param max_regs Maximum number of registers of a request, up to REGS
+	 * @return uint8_t number of requests, 0 if a read is invalid, more than BLOCKS requests are needed
+	 * 		or a request of the current plan is still on the bus
+	 */
+	uint8_t plan(rak13015_read_t *reads, uint16_t count, uint16_t gap = 0, uint8_t max_regs = REGS)
+	{
+		if (busy())
+		{
+			return 0;
+		}
+		_blocks = 0;
+		_next = 0;
+		_reads = reads;
+		max_regs = ((max_regs == 0) || (max_regs > REGS)) ? REGS : max_regs;
+		for (uint16_t idx = 0; idx < count; idx++)
+		{
+			if ((reads[idx].function != MB_FC_READ_REGISTERS) && (reads[idx].function != MB_FC_READ_INPUT_REGISTER))
+			{
+				return 0;
+			}
+		}
+		sort(reads, count);
+
+		for (uint16_t idx = 0; idx < count; idx++)
+		{
+			const rak13015_read_t &read = reads[idx];
+			if (_blocks != 0)
+			{
+				block_t &block = _block[_blocks - 1];
+				uint32_t end = (uint32_t)block.address + block.count; // first register after the block
+				if ((read.slave == block.slave) && (read.function == block.function) &&
+					((uint32_t)read.address <= end + gap) && ((uint32_t)read.address + 1 - block.address <= max_regs))
+				{
+					if (read.address >= end)
+					{
+						block.count = read.address + 1 - block.address;
+					}
+					block.reads++;
+					continue;
+				}
+			}
+			if (_blocks == BLOCKS)
+			{
+				_blocks = 0;
+				return 0;
+			}
+			block_t &block = _block[_blocks++];
+			block.slave = read.slave;
+			block.function = read.function;
+			block.address = read.address;
+			block.count = 1;
+			block.first = idx;
+			block.reads = 1;
+		}
+		return _blocks;
+	}
+
+	/**
+	 * @brief Number of requests of the plan
+	 */
+	uint8_t requests(void) { return _blocks; }
+
+	/**
+	 * @brief Read all requests of the plan one after the other, blocking
+	 *
+	 * @param timeout Timeout in ms for each response
+	 * @return uint8_t number of successful requests, 0 if a request is still on the bus
+	 */
+	uint8_t execute(uint16_t timeout = 1000)
+	{
+		if (!start(timeout))
+		{
+			return 0;
+		}
+		while (service())
+		{
+		}
+		return _success;
+	}
+
+	/**
+	 * @brief Start reading the requests of the plan without blocking, service() sends them
+	 *
+	 * @param timeout Timeout in ms for each response
+	 * @return true if the reading was started
+	 * @return false if a request of the last start() is still on the bus, call service() until it returns false
+	 */
+	bool start(uint16_t timeout = 1000)
+	{
+		if (busy())
+		{
+			return false;
+		}
+		_timeout = timeout;
+		_next = 0;
+		_success = 0;
+		return true;
+	}
+
+	/**
+	 * @brief Advance the reading of the plan, call frequently from loop() after start()
+	 *
+	 * @return true while requests are not finished
+	 * @return false when all requests are finished
+	 */
+	bool service(void)
+	{
+		_module.serviceModbus();
+		if (_active)
+		{
+			if ((_transaction.status == RAK13015_MB_QUEUED) || (_transaction.status == RAK13015_MB_BUSY))
+			{
+				return true;
+			}
+			_active = false;
+			if (_transaction.status == RAK13015_MB_DONE)
+			{
+				scatter(_block[_next]);
+				_success++;
+			}
+			_next++;
+		}
+		if (_next >= _blocks)
+		{
+			return false;
+		}
+		const block_t &block = _block[_next];
+		_transaction.slave = block.slave;
+		_transaction.function = block.function;
+		_transaction.address = block.address;
+		_transaction.count = block.count;
+		_transaction.regs = _buffer;
+		_transaction.timeout = _timeout;
+		_transaction.status = RAK13015_MB_IDLE;
+		if (_module.submitModbus(&_transaction))
+		{
+			_active = true;
+		}
+		else
+		{
+			_next++;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Number of successful requests of the last execute() or start()
+	 */
+	uint8_t success(void) { return _success; }
+
+private:
+	/** A submitted request is still queued or sent by the module, a finished one is dropped */
+	bool busy(void)
+	{
+		if (!_active)
+		{
+			return false;
+		}
+		_module.serviceModbus();
+		if ((_transaction.status == RAK13015_MB_QUEUED) || (_transaction.status == RAK13015_MB_BUSY))
+		{
+			return true;
+		}
+		_active = false;
+		return false;
+	}
+
+	/** One request of the plan */
+	typedef struct
+	{
+		uint8_t slave;
+		uint8_t function;
+		uint16_t address;
+		uint8_t count;	//!< registers read, including the unrequested ones
+		uint16_t first; //!< index of the first read of the request
+		uint16_t reads; //!< number of reads of the request
+	} block_t;
+
+	/** Insertion sort, stable and small, the read lists are short */
+	static void sort(rak13015_read_t *reads, uint16_t count)
+	{
+		for (uint16_t idx = 1; idx < count; idx++)
+		{
+			rak13015_read_t read = reads[idx];
+			uint32_t key = sortKey(read);
+			uint16_t pos = idx;
+			while ((pos > 0) && (sortKey(reads[pos - 1]) > key))
+			{
+				reads[pos] = reads[pos - 1];
+				pos--;
+			}
+			reads[pos] = read;
+		}
+	}
+
+	static uint32_t sortKey(const rak13015_read_t &read)
+	{
+		return ((uint32_t)read.slave << 24) | ((uint32_t)read.function << 16) | read.address;
+	}
+
+	void scatter(const block_t &block)
+	{
+		for (uint16_t idx = block.first; idx < block.first + block.reads; idx++)
+		{
+			if (_reads[idx].dest != NULL)
+			{
+				*_reads[idx].dest = _buffer[_reads[idx].address - block.address];
+			}
+		}
+	}
+
+	RAK13015 &_module;
+	rak13015_read_t *_reads = NULL;
+	block_t _block[BLOCKS];
+	uint8_t _blocks = 0;
+	uint8_t _next = 0;	   //!< request on the bus or to be sent
+	uint8_t _success = 0;  //!< successful requests
+	bool _active = false;  //!< _transaction is submitted
+	uint16_t _timeout = 1000;
+	rak13015_modbus_t _transaction = {}; //!< request on the bus, status RAK13015_MB_IDLE before the first start()
+	uint16_t _buffer[REGS]; //!< response of the request on the bus
+};
+
+#endif // _RAK13015_READPLANNER_H_
@@ -0,0 +1,285 @@
+/**
+ * @file RAK13015_Scheduler.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Cyclic Modbus poll scheduler with per-item period and priority
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _RAK13015_SCHEDULER_H_
+#define _RAK13015_SCHEDULER_H_
+
+#include <Arduino.h>
+#include "RAK13015.h"
+
+/**
+ * @brief Poll item of the scheduler table
+ */
+typedef struct
+{
+	uint8_t slave;	   //!< Slave address 1 ... 247
+	uint8_t function;  //!< MB_FC_READ_COILS ... MB_FC_WRITE_MULTIPLE_REGISTERS
+	uint16_t address;  //!< Register/Coil start address
+	uint16_t count;	   //!< Number of registers/coils
+	uint16_t *regs;	   //!< Buffer for the data read or with the data to write
+	uint16_t timeout;  //!< Timeout in ms for the response
+	uint32_t period;   //!< Poll period in ms, 0 to disable the item
+	uint8_t priority;  //!< 0 is the highest priority, used when several items are due
+} rak13015_poll_t;
+
+/**
+ * @brief Statistics of a poll item
+ */
+typedef struct
+{
+	uint32_t polls;		  //!< Transactions sent
+	uint32_t errors;	  //!< Transactions that ended with exception, timeout or error
+	uint32_t missed;	  //!< Deadlines skipped because the item was late by a full period or more
+	uint32_t jitter_last; //!< Delay in ms between deadline and start of the last poll
+	uint32_t jitter_max;  //!< Largest delay in ms between deadline and start of a poll
+	float jitter_mean;	  //!< Mean delay in ms between deadline and start of a poll
+} rak13015_poll_stats_t;
+
+/**
+ * @brief Cyclic scheduler for a static table of Modbus poll items.
+ * 		Each item is due every period ms. Due items are sent back-to-back through submitModbus(), the highest
+ * 		priority first and the earliest deadline first within a priority. Deadlines stay on the period grid,
+ * 		an item that started late is due again one period after its deadline, not one period after it was sent.
+ * 		An item late by a full period or more counts the skipped deadlines as missed and serves the latest one.
+ * 		Only one transaction of the scheduler is on the bus at a time.
+ *
+ * @tparam SIZE Maximum number of poll items
+ *
+ * @par Usage
+ * @code
+ * uint16_t meter[4];
+ * uint16_t status[1];
+ * uint16_t level[2];
+ * rak13015_poll_t poll_table[3] = {
+ * 	{1, MB_FC_READ_REGISTERS, 0, 4, meter, 500, 1000, 1},	 // meter every second
+ * 	{1, MB_FC_READ_REGISTERS, 100, 1, status, 500, 250, 0}, // status every 250 ms, most important
+ * 	{2, MB_FC_READ_REGISTERS, 0, 2, level, 500, 5000, 2},	 // level every 5 seconds
+ * };
+ * RAK13015_Scheduler<3> scheduler(rak_in);
+ * scheduler.begin(poll_table, 3);
+ * // in loop()
+ * scheduler.service();
+ * rak13015_poll_stats_t stats;
+ * scheduler.getStatistics(1, stats);
+ * Serial.printf("Status polls %ld missed %ld jitter max %ld ms\r\n", stats.polls, stats.missed, stats.jitter_max);
+ * @endcode
+ */
+template <uint8_t SIZE>
+class RAK13015_Scheduler
+{
+	static_assert(SIZE >= 1, "Scheduler needs at least 1 poll item");
+
+public:
+	/**
+	 * @brief Scheduler for the Modbus master of a module
+	 *
+	 * @param module Module with the RS485 interface, must be initialized with initRAK13015() or initModbus()
+	 */
+	RAK13015_Scheduler(RAK13015 &module) : _module(module) {}
+
+	/**
+	 * @brief Set the poll table and start polling, all items are due immediately.
+	 * 		A transaction of the previous table that is still on the bus must be finished first,
+	 * 		call stop() and service() until service() returns SIZE
+	 *
+	 * @param items Poll table, must stay valid while the scheduler is used
+	 * @param count Number of items, up to SIZE
+	 * @param now Current time in ms
+	 * @return true if the table was accepted
+	 * @return false if count is 0 or larger than SIZE or a transaction is still on the bus
+	 */
+	bool begin(const rak13015_poll_t *items, uint8_t count, uint32_t now = millis())
+	{
+		if ((items == NULL) || (count == 0) || (count > SIZE))
+		{
+			return false;
+		}
+		if (_current != NONE)
+		{
+			// _transaction is still queued in the module, it must not be reused
+			_module.serviceModbus();
+			if ((_transaction.status == RAK13015_MB_QUEUED) || (_transaction.status == RAK13015_MB_BUSY))
+			{
+				return false;
+			}
+			finish();
+		}
+		_items = items;
+		_count = count;
+		for (uint8_t index = 0; index < _count; index++)
+		{
+			_deadline[index] = now;
+			_status[index] = RAK13015_MB_IDLE;
+			memset(&_stats[index], 0, sizeof(rak13015_poll_stats_t));
+		}
+		_running = true;
+		return true;
+	}
+
+	/**
+	 * @brief Stop polling, a transaction on the bus is still finished by service()
+	 */
+	void stop(void) { _running = false; }
+
+	/**
+	 * @brief Set a function that is called when a poll item is finished
+	 *
+	 * @param callback Called with the item index and the finished transaction, NULL for none
+	 */
+	void onComplete(void (*callback)(uint8_t index, rak13015_modbus_t *transaction)) { _callback = callback; }
+
+	/**
+	 * @brief Advance the scheduler, call frequently from loop()
+	 * 		Calls serviceModbus() of the module, finishes the running item and sends the next due item
+	 *
+	 * @param now Current time in ms
+	 * @return uint8_t index of the item on the bus, SIZE if none
+	 */
+	uint8_t service(uint32_t now = millis())
+	{
+		_module.serviceModbus();
+		if (_current != NONE)
+		{
+			if ((_transaction.status == RAK13015_MB_QUEUED) || (_transaction.status == RAK13015_MB_BUSY))
+			{
+				return _current;
+			}
+			finish();
+		}
+		if (!_running)
+		{
+			return NONE;
+		}
+		// Send the next due item right away to keep the bus busy
+		uint8_t next = nextDue(now);
+		if (next != NONE)
+		{
+			dispatch(next, now);
+		}
+		return _current;
+	}
+
+	/**
+	 * @brief Get the statistics of a poll item
+	 *
+	 * @param index Item index
+	 * @param stats Receives the statistics
+	 * @param reset Clear the statistics after reading
+	 * @return true if the index is valid
+	 */
+	bool getStatistics(uint8_t index, rak13015_poll_stats_t &stats, bool reset = false)
+	{
+		if (index >= _count)
+		{
+			return false;
+		}
+		stats = _stats[index];
+		if (reset)
+		{
+			memset(&_stats[index], 0, sizeof(rak13015_poll_stats_t));
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Status of the last transaction of a poll item
+	 *
+	 * @param index Item index
+	 * @return uint8_t RAK13015_MB_IDLE if not polled yet, RAK13015_MB_DONE ... RAK13015_MB_ERROR
+	 */
+	uint8_t lastStatus(uint8_t index) { return index < _count ? _status[index] : RAK13015_MB_IDLE; }
+
+private:
+	/** No item selected */
+	static const uint8_t NONE = SIZE;
+
+	/** Highest priority due item, earliest deadline first within a priority */
+	uint8_t nextDue(uint32_t now)
+	{
+		uint8_t next = NONE;
+		for (uint8_t index = 0; index < _count; index++)
+		{
+			if ((_items[index].period == 0) || ((int32_t)(now - _deadline[index]) < 0))
+			{
+				continue;
+			}
+			if ((next == NONE) || (_items[index].priority < _items[next].priority) ||
+				((_items[index].priority == _items[next].priority) &&
+				 ((int32_t)(_deadline[index] - _deadline[next]) < 0)))
+			{
+				next = index;
+			}
+		}
+		return next;
+	}
+
+	void dispatch(uint8_t index, uint32_t now)
+	{
+		const rak13015_poll_t &item = _items[index];
+		rak13015_poll_stats_t &stats = _stats[index];
+		uint32_t late = now - _deadline[index];
+		if (late >= item.period)
+		{
+			// Overrun, serve the latest deadline and keep the period grid
+			uint32_t skipped = late / item.period;
+			stats.missed += skipped;
+			_deadline[index] += skipped * item.period;
+			late -= skipped * item.period;
+		}
+		_deadline[index] += item.period;
+
+		stats.polls++;
+		stats.jitter_last = late;
+		stats.jitter_max = late > stats.jitter_max ? late : stats.jitter_max;
+		stats.jitter_mean += ((float)late - stats.jitter_mean) / stats.polls;
+
+		_transaction.slave = item.slave;
+		_transaction.function = item.function;
+		_transaction.address = item.address;
+		_transaction.count = item.count;
+		_transaction.regs = item.regs;
+		_transaction.timeout = item.timeout;
+		_transaction.status = RAK13015_MB_IDLE;
+		_current = index;
+		if (!_module.submitModbus(&_transaction))
+		{
+			_transaction.status = RAK13015_MB_ERROR;
+			finish();
+		}
+	}
+
+	void finish(void)
+	{
+		uint8_t index = _current;
+		_current = NONE;
+		_status[index] = _transaction.status;
+		if (_transaction.status != RAK13015_MB_DONE)
+		{
+			_stats[index].errors++;
+		}
+		if (_callback != NULL)
+		{
+			_callback(index, &_transaction);
+		}
+	}
+
+	RAK13015 &_module;
+	const rak13015_poll_t *_items = NULL;
+	uint8_t _count = 0;
+	bool _running = false;
+	uint8_t _current = NONE;						   //!< item on the bus
+	rak13015_modbus_t _transaction;					   //!< transaction of the item on the bus
+	void (*_callback)(uint8_t index, rak13015_modbus_t *transaction) = NULL;
+	uint32_t _deadline[SIZE];						   //!< next deadline of each item in ms
+	uint8_t _status[SIZE] = {};						   //!< status of the last transaction of each item
+	rak13015_poll_stats_t _stats[SIZE];
+};
+
+#endif // _RAK13015_SCHEDULER_H_
@@ -0,0 +1,213 @@
+/**
+ * @file RAK13015_Trigger.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Pre/post trigger capture of the acquisition samples
+ * @version 0.1
+ * @date 2024-05-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _RAK13015_TRIGGER_H_
+#define _RAK13015_TRIGGER_H_
+
+#include <Arduino.h>
+#include "RAK13015.h"
+
+// Trigger conditions
+#define RAK13015_TRIGGER_RISING 0		//!< sample crosses the level upwards
+#define RAK13015_TRIGGER_FALLING 1		//!< sample crosses the level downwards
+#define RAK13015_TRIGGER_SLOPE_RISING 2	//!< sample rises by at least the level from the previous sample
+#define RAK13015_TRIGGER_SLOPE_FALLING 3 //!< sample falls by at least the level from the previous sample
+
+/**
+ * @brief Trigger engine for one channel, captures a window of pre-trigger and post-trigger samples.
+ * 		Samples are fed from the interrupt driven acquisition, the pre-trigger history is kept in a circular buffer.
+ * 		When the condition fires, the post-trigger samples are collected and the window is frozen until it is read.
+ * 		All memory is statically allocated for SIZE samples, nothing is allocated at trigger time.
+ *
+ * @tparam SIZE Maximum window size in samples, pre + post
+ *
+ * @par Usage
+ * @code
+ * RAK13015_Trigger<128> trigger;
+ * rak13015_sample_t samples[32];
+ * rak13015_sample_t window[128];
+ * // 32 samples before and 96 samples after the current rises above 12 mA
+ * trigger.setup(RAK13015_CH_4_20_0, RAK13015_TRIGGER_RISING, rak_in.toRaw(RAK13015_CH_4_20_0, 12.0), 32, 96);
+ * trigger.arm();
+ * rak_in.startAcquisition(RAK13015_CH_4_20_0, SGM58031_DR_800);
+ * // in loop()
+ * rak_in.serviceAcquisition();
+ * uint16_t count = rak_in.readAcquisition(samples, 32);
+ * for (uint16_t idx = 0; idx < count; idx++)
+ * {
+ * 	if (trigger.update(samples[idx]))
+ * 	{
+ * 		uint16_t size = trigger.read(window, 128);
+ * 		// upload window, window[32] is the trigger sample
+ * 		trigger.arm();
+ * 	}
+ * }
+ * @endcode
+ */
+template <uint16_t SIZE>
+class RAK13015_Trigger
+{
+	static_assert((SIZE >= 2) && (SIZE <= 32768), "Trigger window must be 2 ... 32768 samples");
+
+public:
+	/**
+	 * @brief Set channel, condition and window, the trigger is disarmed
+	 *
+	 * @param channel Channel index RAK13015_CH_4_20_0 ... RAK13015_CH_ANA_1, samples of other channels are ignored
+	 * @param type RAK13015_TRIGGER_RISING ... RAK13015_TRIGGER_SLOPE_FALLING
+	 * @param level Level or slope per sample in raw counts
+	 * @param pre Samples before the trigger sample
+	 * @param post Samples from the trigger sample on, at least 1
+	 * @return true if the settings are valid
+	 * @return false if pre + post is larger than SIZE
+	 */
+	bool setup(uint8_t channel, uint8_t type, int16_t level, uint16_t pre, uint16_t post)
+	{
+		_state = TRIG_IDLE;
+		if ((channel >= RAK13015_NUM_CH) || (type > RAK13015_TRIGGER_SLOPE_FALLING) || (post == 0) ||
+			((uint32_t)pre + post > SIZE))
+		{
+			return false;
+		}
+		_channel = channel;
+		_type = type;
+		_level = level;
+		_pre = pre;
+		_post = post;
+		return true;
+	}
+
+	/**
+	 * @brief Start a new capture, the pre-trigger history is collected again
+	 */
+	void arm(void)
+	{
+		_count = 0;
+		_head = 0;
+		_state = TRIG_ARMED;
+	}
+
+	/**
+	 * @brief Stop watching for the trigger condition
+	 */
+	void disarm(void) { _state = TRIG_IDLE; }
+
+	/**
+	 * @brief Check if a captured window is waiting to be read
+	 */
+	bool isTriggered(void) { return _state == TRIG_DONE; }
+
+	/**
+	 * @brief Add an acquisition sample
+	 *
+	 * @param sample Sample from readAcquisition()
+	 * @return true if the window was completed with this sample
+	 */
+	bool update(const rak13015_sample_t &sample)
+	{
+		if ((sample.channel != _channel) || (_state == TRIG_IDLE) || (_state == TRIG_DONE))
+		{
+			return false;
+		}
+		// The first sample has no previous sample, the window needs pre samples before the trigger sample
+		bool fired = (_state == TRIG_ARMED) && (_count != 0) && (_count >= _pre) && condition(sample.raw);
+		_previous = sample.raw;
+		_history[_head] = sample;
+		_head = (_head + 1) % SIZE;
+		if (_count < SIZE)
+		{
+			_count++;
+		}
+		if (fired)
+		{
+			// The trigger sample starts the post-trigger part
+			_trigger = (_head + SIZE - 1) % SIZE;
+			_remaining = _post;
+			_state = TRIG_POST;
+		}
+		if ((_state == TRIG_POST) && (--_remaining == 0))
+		{
+			_state = TRIG_DONE;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Copy the captured window, oldest first. The trigger sample is at index pre
+	 *
+	 * @param samples Buffer for the window
+	 * @param max_samples Size of the buffer
+	 * @return uint16_t number of samples copied, 0 if no window was captured
+	 */
+	uint16_t read(rak13015_sample_t *samples, uint16_t max_samples)
+	{
+		if (_state != TRIG_DONE)
+		{
+			return 0;
+		}
+		uint16_t size = _pre + _post;
+		size = size < max_samples ? size : max_samples;
+		uint16_t pos = (_trigger + SIZE - _pre) % SIZE;
+		for (uint16_t idx = 0; idx < size; idx++)
+		{
+			samples[idx] = _history[pos];
+			pos = (pos + 1) % SIZE;
+		}
+		return size;
+	}
+
+	/**
+	 * @brief Timestamp of the trigger sample of the captured window
+	 *
+	 * @return uint32_t micros() of the trigger sample, 0 if no window was captured
+	 */
+	uint32_t triggerTime(void) { return _state == TRIG_DONE ? _history[_trigger].timestamp : 0; }
+
+private:
+	bool condition(int16_t raw)
+	{
+		switch (_type)
+		{
+		case RAK13015_TRIGGER_RISING:
+			return (_previous < _level) && (raw >= _level);
+		case RAK13015_TRIGGER_FALLING:
+			return (_previous > _level) && (raw <= _level);
+		case RAK13015_TRIGGER_SLOPE_RISING:
+			return ((int32_t)raw - _previous) >= _level;
+		default:
+			return ((int32_t)_previous - raw) >= _level;
+		}
+	}
+
+	/** Capture states */
+	enum
+	{
+		TRIG_IDLE = 0,
+		TRIG_ARMED,
+		TRIG_POST,
+		TRIG_DONE
+	};
+
+	uint8_t _state = TRIG_IDLE;
+	uint8_t _channel = RAK13015_NUM_CH;
+	uint8_t _type = RAK13015_TRIGGER_RISING;
+	int16_t _level = 0;
+	int16_t _previous = 0; //!< previous sample for crossing and slope detection
+	uint16_t _pre = 0;
+	uint16_t _post = 1;
+	uint16_t _count = 0;				//!< samples in the history, up to SIZE
+	uint16_t _head = 0;					//!< next write position
+	uint16_t _trigger = 0;				//!< position of the trigger sample
+	uint16_t _remaining = 0;			//!< post-trigger samples still to collect
+	rak13015_sample_t _history[SIZE]; //!< pre-trigger history and captured window
+};
+
+#endif // _RAK13015_TRIGGER_H_